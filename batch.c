@@ -0,0 +1,212 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+
+typedef struct {
+  char *name;
+  off_t size;
+} batch_file_t;
+
+// one worker's share of the files; the owner pops from head, thieves from tail
+typedef struct {
+  pthread_mutex_t lock;
+  size_t *items;
+  size_t head, tail;
+} batch_queue_t;
+
+typedef struct {
+  const char *indir;
+  const char *outdir;
+  batch_file_t *files;
+  batch_queue_t *queues;
+  size_t threads;
+  batch_job_fn job;
+  void *arg;
+  pthread_mutex_t lock; // guards failures
+  size_t failures;
+} batch_t;
+
+typedef struct {
+  batch_t *batch;
+  size_t id;
+} batch_worker_t;
+
+static int by_size_desc(const void *a, const void *b) {
+  off_t sa = ((const batch_file_t *)a)->size;
+  off_t sb = ((const batch_file_t *)b)->size;
+  return (sa < sb) - (sa > sb);
+}
+
+static char *join_path(const char *dir, const char *name) {
+  size_t len = strlen(dir) + strlen(name) + 2;
+  char *path = (char *)malloc(len);
+  snprintf(path, len, "%s/%s", dir, name);
+  return path;
+}
+
+static bool queue_pop(batch_queue_t *q, bool own, size_t *item) {
+  bool got = false;
+  pthread_mutex_lock(&q->lock);
+  if (q->head < q->tail) {
+    *item = own ? q->items[q->head++] : q->items[--q->tail];
+    got = true;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return got;
+}
+
+static void run_one(batch_t *b, batch_file_t *f) {
+  char *inpath = join_path(b->indir, f->name);
+  char *outpath = join_path(b->outdir, f->name);
+  const char *reason = NULL;
+
+  FILE *infile = fopen(inpath, "r");
+  FILE *outfile = infile ? fopen(outpath, "w") : NULL;
+  if (infile == NULL) {
+    reason = "cannot open input";
+  } else if (outfile == NULL) {
+    reason = "cannot open output";
+  } else if (!b->job(infile, outfile, b->arg)) {
+    reason = "failed";
+  }
+  if (outfile != NULL && fclose(outfile) != 0 && reason == NULL) {
+    reason = "cannot write output";
+  }
+  if (infile != NULL) {
+    fclose(infile);
+  }
+
+  if (reason != NULL) {
+    fprintf(stderr, "%s: %s\n", inpath, reason);
+    pthread_mutex_lock(&b->lock);
+    b->failures++;
+    pthread_mutex_unlock(&b->lock);
+  }
+  free(inpath);
+  free(outpath);
+}
+
+static void *worker(void *p) {
+  batch_worker_t *w = (batch_worker_t *)p;
+  batch_t *b = w->batch;
+  size_t item;
+
+  for (;;) {
+    if (queue_pop(&b->queues[w->id], true, &item)) {
+      run_one(b, &b->files[item]);
+      continue;
+    }
+    // own queue is empty: steal, and stop once every queue is empty
+    bool stole = false;
+    for (size_t i = 1; i < b->threads && !stole; i++) {
+      stole = queue_pop(&b->queues[(w->id + i) % b->threads], false, &item);
+    }
+    if (!stole) {
+      break;
+    }
+    run_one(b, &b->files[item]);
+  }
+  return NULL;
+}
+
+size_t batch_run(const char *indir, const char *outdir, size_t threads,
+                 batch_job_fn job, void *arg) {
+
+  // compare the directories themselves, so "in" and "./in/" also match
+  struct stat st, out;
+  if (stat(indir, &st) == 0 && stat(outdir, &out) == 0 &&
+      st.st_dev == out.st_dev && st.st_ino == out.st_ino) {
+    return BATCH_SAME_DIR;
+  }
+
+  DIR *dir = opendir(indir);
+  if (dir == NULL) {
+    return SIZE_MAX;
+  }
+
+  // collect the regular files with their sizes
+  size_t count = 0, cap = 64;
+  batch_file_t *files = (batch_file_t *)malloc(cap * sizeof(batch_file_t));
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    char *path = join_path(indir, entry->d_name);
+    bool regular = (stat(path, &st) == 0 && S_ISREG(st.st_mode));
+    free(path);
+    if (!regular) {
+      continue;
+    }
+    if (count == cap) {
+      cap *= 2;
+      files = (batch_file_t *)realloc(files, cap * sizeof(batch_file_t));
+    }
+    files[count].name = strdup(entry->d_name);
+    files[count].size = st.st_size;
+    count++;
+  }
+  closedir(dir);
+
+  if (count == 0) {
+    free(files);
+    return 0;
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+  if (threads > count) {
+    threads = count;
+  }
+
+  // deal largest first, round robin, so every queue starts with a fair mix
+  qsort(files, count, sizeof(batch_file_t), by_size_desc);
+  batch_t b = {indir, outdir, files, NULL, threads, job, arg,
+               PTHREAD_MUTEX_INITIALIZER, 0};
+  b.queues = (batch_queue_t *)calloc(threads, sizeof(batch_queue_t));
+  for (size_t t = 0; t < threads; t++) {
+    pthread_mutex_init(&b.queues[t].lock, NULL);
+    b.queues[t].items =
+        (size_t *)malloc((count / threads + 1) * sizeof(size_t));
+  }
+  for (size_t i = 0; i < count; i++) {
+    batch_queue_t *q = &b.queues[i % threads];
+    q->items[q->tail++] = i;
+  }
+
+  pthread_t *tids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+  batch_worker_t *workers =
+      (batch_worker_t *)malloc(threads * sizeof(batch_worker_t));
+  // a thread that cannot be started leaves its queue to be stolen by the
+  // others; with none started, this thread runs the batch itself
+  size_t started = 0;
+  for (size_t t = 0; t < threads; t++) {
+    workers[t].batch = &b;
+    workers[t].id = t;
+    if (pthread_create(&tids[started], NULL, worker, &workers[t]) == 0) {
+      started++;
+    }
+  }
+  if (started == 0) {
+    worker(&workers[0]);
+  }
+  for (size_t t = 0; t < started; t++) {
+    pthread_join(tids[t], NULL);
+  }
+
+  for (size_t t = 0; t < threads; t++) {
+    pthread_mutex_destroy(&b.queues[t].lock);
+    free(b.queues[t].items);
+  }
+  for (size_t i = 0; i < count; i++) {
+    free(files[i].name);
+  }
+  pthread_mutex_destroy(&b.lock);
+  free(b.queues);
+  free(tids);
+  free(workers);
+  free(files);
+  return b.failures;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// returned by batch_run() when indir and outdir are the same directory,
+// where every output would truncate its own input
+#define BATCH_SAME_DIR (SIZE_MAX - 1)
+
+//
+// Processes one file of a batch.
+// Called concurrently from several threads, so it must only read shared state
+// (e.g. an already loaded key) through arg.
+//
+// infile: the opened input file.
+// outfile: the opened output file.
+// arg: the caller's context passed to batch_run().
+// returns: true on success, false if this file failed.
+//
+typedef bool (*batch_job_fn)(FILE *infile, FILE *outfile, void *arg);
+
+//
+// Runs job on every regular file in indir, writing each result to the file
+// of the same name in outdir.
+// Files are dealt largest first across per-thread queues; a thread that runs
+// dry steals from the tail of another thread's queue, so a few large files
+// do not leave the other threads idle.
+// A failing file is reported on stderr and does not stop the batch.
+//
+// indir: the directory holding the input files.
+// outdir: the existing directory to write the output files to.
+// threads: the number of worker threads (at least 1).
+// job: the function applied to each file.
+// arg: passed through to job.
+// returns: the number of files that failed, SIZE_MAX if indir could not be
+//          read, or BATCH_SAME_DIR if outdir is indir.
+//
+size_t batch_run(const char *indir, const char *outdir, size_t threads,
+                 batch_job_fn job, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,136 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "batchgcd.h"
+
+typedef enum { PRODUCT, REMAINDER, LEAF } level_op_t;
+
+// one tree level's worth of work, shared by the threads splitting it
+typedef struct {
+  level_op_t op;
+  mpz_t *below; // the level being written (or the leaves)
+  mpz_t *above; // the level it is computed from
+  size_t size;  // number of nodes in below
+  size_t rows;  // number of nodes in above
+  mpz_t *g;     // LEAF results
+  mpz_t *n;     // LEAF moduli
+} level_t;
+
+typedef struct {
+  level_t *level;
+  size_t from, to;
+} slice_t;
+
+static void *run_slice(void *p) {
+  slice_t *slice = (slice_t *)p;
+  level_t *l = slice->level;
+  mpz_t square;
+  mpz_init(square);
+
+  for (size_t i = slice->from; i < slice->to; i++) {
+    switch (l->op) {
+    case PRODUCT:
+      // above[i] = below[2i] * below[2i + 1], an odd node out moves up as is
+      if (2 * i + 1 < l->size) {
+        mpz_mul(l->above[i], l->below[2 * i], l->below[2 * i + 1]);
+      } else {
+        mpz_set(l->above[i], l->below[2 * i]);
+      }
+      break;
+    case REMAINDER:
+      // below[i] = above[i / 2] mod below[i]^2, in place
+      mpz_mul(square, l->below[i], l->below[i]);
+      mpz_mod(l->below[i], l->above[i / 2], square);
+      break;
+    case LEAF:
+      // gcd(n, (P mod n^2) / n) = gcd(n, P / n)
+      mpz_mul(square, l->n[i], l->n[i]);
+      mpz_mod(l->g[i], l->above[i / 2], square);
+      mpz_divexact(l->g[i], l->g[i], l->n[i]);
+      mpz_gcd(l->g[i], l->g[i], l->n[i]);
+      break;
+    }
+  }
+
+  mpz_clear(square);
+  return NULL;
+}
+
+// split nodes [0, work) of a level evenly across the threads
+static void run_level(level_t *level, size_t work, size_t threads) {
+  if (threads > work) {
+    threads = work;
+  }
+  if (threads <= 1) {
+    slice_t all = {level, 0, work};
+    run_slice(&all);
+    return;
+  }
+
+  pthread_t *tids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+  slice_t *slices = (slice_t *)malloc(threads * sizeof(slice_t));
+  for (size_t t = 0; t < threads; t++) {
+    slices[t].level = level;
+    slices[t].from = work * t / threads;
+    slices[t].to = work * (t + 1) / threads;
+    pthread_create(&tids[t], NULL, run_slice, &slices[t]);
+  }
+  for (size_t t = 0; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+  free(tids);
+  free(slices);
+}
+
+void batch_gcd(mpz_t g[], mpz_t n[], size_t count, size_t threads) {
+
+  if (count < 2) {
+    for (size_t i = 0; i < count; i++) {
+      mpz_set_ui(g[i], 1);
+    }
+    return;
+  }
+
+  // levels[0] = moduli (the caller's, never written), levels[depth - 1] =
+  // product of all of them
+  size_t depth = 1;
+  for (size_t width = count; width > 1; width = (width + 1) / 2) {
+    depth++;
+  }
+  mpz_t **levels = (mpz_t **)malloc(depth * sizeof(mpz_t *));
+  size_t *sizes = (size_t *)malloc(depth * sizeof(size_t));
+
+  sizes[0] = count;
+  levels[0] = n;
+
+  // product tree, bottom up
+  for (size_t k = 1; k < depth; k++) {
+    sizes[k] = (sizes[k - 1] + 1) / 2;
+    levels[k] = (mpz_t *)malloc(sizes[k] * sizeof(mpz_t));
+    for (size_t i = 0; i < sizes[k]; i++) {
+      mpz_init(levels[k][i]);
+    }
+    level_t level = {PRODUCT, levels[k - 1], levels[k], sizes[k - 1],
+                     sizes[k],  NULL,         NULL};
+    run_level(&level, sizes[k], threads);
+  }
+
+  // remainder tree, top down, overwriting each product with its remainder;
+  // the root is its own remainder
+  for (size_t k = depth - 1; k > 1; k--) {
+    level_t level = {REMAINDER, levels[k - 1], levels[k], sizes[k - 1],
+                     sizes[k],  NULL,          NULL};
+    run_level(&level, sizes[k - 1], threads);
+  }
+  level_t leaves = {LEAF, levels[0], levels[1], count, sizes[1], g, n};
+  run_level(&leaves, count, threads);
+
+  for (size_t k = 1; k < depth; k++) {
+    for (size_t i = 0; i < sizes[k]; i++) {
+      mpz_clear(levels[k][i]);
+    }
+    free(levels[k]);
+  }
+  free(levels);
+  free(sizes);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <gmp.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Batch GCD (Bernstein's product and remainder trees).
+// Computes g[i] = gcd(n[i], product of every other n[j]) for all i at once in
+// quasi-linear time, instead of one gcd per pair. g[i] == 1 means n[i] shares
+// no factor with any other modulus; g[i] == n[i] usually means n[i] appears
+// more than once in the list.
+// Each tree level is split across the given number of threads.
+// All mpz_t arguments are expected to be initialized.
+//
+// g: will store one gcd per modulus.
+// n: the moduli to check.
+// count: the number of moduli.
+// threads: the number of worker threads (at least 1).
+//
+void batch_gcd(mpz_t g[], mpz_t n[], size_t count, size_t threads);
+
+#ifdef __cplusplus
+}
+#endif
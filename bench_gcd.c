@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "numtheory.h"
+
+// operand pairs per size; the result is averaged over all of them
+#define PAIRS 200
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the one-quotient-per-step Euclid loop gcd_ext replaced, kept as a baseline
+static void euclid_ext(mpz_t g, mpz_t s, mpz_t a, mpz_t b) {
+  mpz_t r, rsub, t, tsub, q, tmp;
+  mpz_inits(r, rsub, t, tsub, q, tmp, NULL);
+  mpz_set(r, a);
+  mpz_set(rsub, b);
+  mpz_set_ui(t, 1);
+  mpz_set_ui(tsub, 0);
+  while (mpz_sgn(rsub) != 0) {
+    mpz_fdiv_q(q, r, rsub);
+    mpz_set(tmp, r);
+    mpz_set(r, rsub);
+    mpz_mul(rsub, q, rsub);
+    mpz_sub(rsub, tmp, rsub);
+    mpz_set(tmp, t);
+    mpz_set(t, tsub);
+    mpz_mul(tsub, q, tsub);
+    mpz_sub(tsub, tmp, tsub);
+  }
+  mpz_set(g, r);
+  mpz_set(s, t);
+  mpz_clears(r, rsub, t, tsub, q, tmp, NULL);
+}
+
+int main(void) {
+
+  gmp_randstate_t rs;
+  gmp_randinit_mt(rs);
+  gmp_randseed_ui(rs, 2022);
+
+  mpz_t a[PAIRS], b[PAIRS], g, s, t, check;
+  mpz_inits(g, s, t, check, NULL);
+  for (int i = 0; i < PAIRS; i++) {
+    mpz_inits(a[i], b[i], NULL);
+  }
+
+  printf("%6s %14s %14s %14s\n", "bits", "euclid (us)", "gcd_ext (us)",
+         "mpz_gcdext (us)");
+  for (unsigned long bits = 2048; bits <= 8192; bits *= 2) {
+    for (int i = 0; i < PAIRS; i++) {
+      mpz_urandomb(a[i], rs, bits);
+      mpz_urandomb(b[i], rs, bits);
+      mpz_setbit(a[i], bits - 1);
+    }
+
+    double start = now();
+    for (int i = 0; i < PAIRS; i++) {
+      euclid_ext(g, s, a[i], b[i]);
+    }
+    double euclid = (now() - start) / PAIRS * 1e6;
+
+    start = now();
+    for (int i = 0; i < PAIRS; i++) {
+      gcd_ext(g, s, t, a[i], b[i]);
+    }
+    double lehmer = (now() - start) / PAIRS * 1e6;
+
+    start = now();
+    for (int i = 0; i < PAIRS; i++) {
+      mpz_gcdext(g, s, t, a[i], b[i]);
+    }
+    double reference = (now() - start) / PAIRS * 1e6;
+
+    // s * a + t * b must equal the reference gcd for every pair
+    for (int i = 0; i < PAIRS; i++) {
+      gcd_ext(g, s, t, a[i], b[i]);
+      mpz_mul(check, s, a[i]);
+      mpz_addmul(check, t, b[i]);
+      mpz_gcd(s, a[i], b[i]);
+      if (mpz_cmp(g, s) != 0 || mpz_cmp(check, g) != 0) {
+        fprintf(stderr, "gcd_ext mismatch at %lu bits, pair %d\n", bits, i);
+        return 1;
+      }
+    }
+
+    printf("%6lu %14.1f %14.1f %14.1f\n", bits, euclid, lehmer, reference);
+  }
+
+  for (int i = 0; i < PAIRS; i++) {
+    mpz_clears(a[i], b[i], NULL);
+  }
+  mpz_clears(g, s, t, check, NULL);
+  gmp_randclear(rs);
+  return 0;
+}
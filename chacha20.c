@@ -0,0 +1,78 @@
+#include <string.h>
+
+#include "chacha20.h"
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define QUARTER(a, b, c, d)                                                    \
+  do {                                                                         \
+    a += b;                                                                    \
+    d = ROTL(d ^ a, 16);                                                       \
+    c += d;                                                                    \
+    b = ROTL(b ^ c, 12);                                                       \
+    a += b;                                                                    \
+    d = ROTL(d ^ a, 8);                                                        \
+    c += d;                                                                    \
+    b = ROTL(b ^ c, 7);                                                        \
+  } while (0)
+
+static uint32_t load32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+// produce the next 64 bytes of keystream and advance the block counter
+static void chacha20_block(chacha20_t *ctx) {
+  uint32_t x[16];
+  memcpy(x, ctx->state, sizeof(x));
+
+  for (int i = 0; i < 10; i++) {
+    QUARTER(x[0], x[4], x[8], x[12]);
+    QUARTER(x[1], x[5], x[9], x[13]);
+    QUARTER(x[2], x[6], x[10], x[14]);
+    QUARTER(x[3], x[7], x[11], x[15]);
+    QUARTER(x[0], x[5], x[10], x[15]);
+    QUARTER(x[1], x[6], x[11], x[12]);
+    QUARTER(x[2], x[7], x[8], x[13]);
+    QUARTER(x[3], x[4], x[9], x[14]);
+  }
+
+  for (int i = 0; i < 16; i++) {
+    uint32_t v = x[i] + ctx->state[i];
+    ctx->stream[4 * i] = (uint8_t)v;
+    ctx->stream[4 * i + 1] = (uint8_t)(v >> 8);
+    ctx->stream[4 * i + 2] = (uint8_t)(v >> 16);
+    ctx->stream[4 * i + 3] = (uint8_t)(v >> 24);
+  }
+  // the nonce is always zero, so its first word extends the 32-bit counter
+  // to 64 bits and files past 256 GiB never repeat keystream
+  if (++ctx->state[12] == 0) {
+    ctx->state[13] += 1;
+  }
+  ctx->used = 0;
+}
+
+void chacha20_init(chacha20_t *ctx, const uint8_t key[CHACHA20_KEY_BYTES]) {
+  // "expand 32-byte k"
+  ctx->state[0] = 0x61707865;
+  ctx->state[1] = 0x3320646e;
+  ctx->state[2] = 0x79622d32;
+  ctx->state[3] = 0x6b206574;
+  for (int i = 0; i < 8; i++) {
+    ctx->state[4 + i] = load32(key + 4 * i);
+  }
+  // block counter and nonce
+  for (int i = 12; i < 16; i++) {
+    ctx->state[i] = 0;
+  }
+  ctx->used = sizeof(ctx->stream);
+}
+
+void chacha20_xor(chacha20_t *ctx, uint8_t *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (ctx->used == sizeof(ctx->stream)) {
+      chacha20_block(ctx);
+    }
+    buf[i] ^= ctx->stream[ctx->used++];
+  }
+}
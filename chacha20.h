@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHACHA20_KEY_BYTES 32
+
+//
+// ChaCha20 keystream state (RFC 8439 block function). The block counter
+// carries into the first nonce word, giving a 64-bit counter as in the
+// original ChaCha design.
+// Used for the bulk data of multi-recipient files, where only the key is
+// wrapped with RSA.
+//
+typedef struct {
+  uint32_t state[16];
+  uint8_t stream[64];
+  size_t used;
+} chacha20_t;
+
+//
+// Initializes the cipher with a key and an all-zero nonce.
+// Every key is freshly generated for one file, so the nonce is never reused.
+//
+// ctx: the state to initialize.
+// key: CHACHA20_KEY_BYTES bytes of key material.
+//
+void chacha20_init(chacha20_t *ctx, const uint8_t key[CHACHA20_KEY_BYTES]);
+
+//
+// XORs the next len bytes of keystream into buf.
+// Encryption and decryption are the same operation.
+//
+// ctx: the initialized cipher state.
+// buf: the data to encrypt or decrypt in place.
+// len: the number of bytes in buf.
+//
+void chacha20_xor(chacha20_t *ctx, uint8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,77 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "stats.h"
+
+#define MIB (1024.0 * 1024.0)
+
+bool checkpoint_load(const char *path, checkpoint_t *ck) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return false;
+  }
+  int got = fscanf(f,
+                   "in %" SCNu64 "\nout %" SCNu64 "\nblocks %" SCNu64
+                   "\nblock %" SCNu64 "\n",
+                   &ck->in_off, &ck->out_off, &ck->blocks, &ck->block);
+  fclose(f);
+  return got == 4;
+}
+
+bool checkpoint_save(const char *path, const checkpoint_t *ck) {
+  size_t len = strlen(path) + 5;
+  char *tmp = (char *)malloc(len);
+  snprintf(tmp, len, "%s.tmp", path);
+
+  FILE *f = fopen(tmp, "w");
+  bool ok = (f != NULL);
+  if (ok) {
+    fprintf(f, "in %" PRIu64 "\nout %" PRIu64 "\nblocks %" PRIu64
+               "\nblock %" PRIu64 "\n",
+            ck->in_off, ck->out_off, ck->blocks, ck->block);
+    ok = (fflush(f) == 0 && fsync(fileno(f)) == 0);
+    ok = (fclose(f) == 0) && ok;
+  }
+  ok = ok && rename(tmp, path) == 0;
+  if (!ok) {
+    unlink(tmp);
+  }
+
+  free(tmp);
+  return ok;
+}
+
+void progress_start(progress_t *p, FILE *infile, uint64_t base) {
+  struct stat st;
+  p->start_ns = p->last_ns = rsa_stats_now_ns();
+  p->base = base;
+  p->total = -1;
+  if (fstat(fileno(infile), &st) == 0 && S_ISREG(st.st_mode)) {
+    p->total = st.st_size;
+  }
+}
+
+void progress_update(progress_t *p, uint64_t done, bool final) {
+  uint64_t now = rsa_stats_now_ns();
+  if (!final && now - p->last_ns < 1000000000ull) {
+    return;
+  }
+  p->last_ns = now;
+
+  // throughput counts only this run, not what a resumed job skipped
+  double seconds = (now - p->start_ns) / 1e9;
+  double rate = seconds > 0 ? (done - p->base) / MIB / seconds : 0;
+  if (p->total > 0) {
+    fprintf(stderr, "\r%5.1f%%  %.1f / %.1f MiB  %.2f MiB/s",
+            100.0 * done / p->total, done / MIB, p->total / MIB, rate);
+  } else {
+    fprintf(stderr, "\r%.1f MiB  %.2f MiB/s", done / MIB, rate);
+  }
+  if (final) {
+    fprintf(stderr, "\n");
+  }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// how often a long encrypt or decrypt records a checkpoint
+#define CHECKPOINT_INTERVAL_NS 5000000000ull
+
+//
+// Position of a resumable job at a block boundary.
+// Stored as a small text sidecar file next to the output.
+//
+typedef struct {
+  uint64_t in_off;  // input bytes consumed
+  uint64_t out_off; // output bytes written
+  uint64_t blocks;  // RSA blocks processed
+  uint64_t block;   // block size k of the key, guards against a key mix-up
+} checkpoint_t;
+
+//
+// Reads a checkpoint sidecar.
+//
+// path: the sidecar file.
+// ck: will store the checkpoint.
+// returns: false if the file is missing or malformed.
+//
+bool checkpoint_load(const char *path, checkpoint_t *ck);
+
+//
+// Atomically replaces a checkpoint sidecar.
+// The new contents are written to a temporary file, synced and renamed over
+// path, so a crash leaves either the old or the new checkpoint.
+//
+// path: the sidecar file.
+// ck: the checkpoint to record.
+// returns: false if the sidecar could not be written.
+//
+bool checkpoint_save(const char *path, const checkpoint_t *ck);
+
+//
+// Progress and throughput reporting on stderr, rate limited to about one
+// line a second.
+//
+typedef struct {
+  uint64_t start_ns;
+  uint64_t last_ns;
+  uint64_t base;  // bytes already done before this run (resume)
+  int64_t total;  // input size, or -1 if unknown (pipes)
+} progress_t;
+
+//
+// Starts a progress report for an input file.
+//
+// p: the report to initialize.
+// infile: the input; its size is used for the percentage when it is known.
+// base: bytes of the input already processed by an earlier run.
+//
+void progress_start(progress_t *p, FILE *infile, uint64_t base);
+
+//
+// Reports progress if a second has passed since the last report, or always
+// when final is set.
+//
+// p: the report.
+// done: input bytes processed so far, including base.
+// final: true for the last report, which ends the line.
+//
+void progress_update(progress_t *p, uint64_t done, bool final);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,54 +1,167 @@
+#include <getopt.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "batch.h"
+#include "lz.h"
 #include "numtheory.h"
 #include "randstate.h"
 #include "rsa.h"
+#include "stats.h"
+
+// the loaded private key, shared read-only by every file of a batch
+typedef struct {
+  mpz_t n;
+  mpz_t d;
+} privkey_t;
+
+static bool decrypt_stream(FILE *infile, FILE *outfile, void *arg) {
+  privkey_t *key = (privkey_t *)arg;
+
+  // compressed and multi-recipient files start with a header, everything
+  // else with hex
+  int first = fgetc(infile);
+  if (first != EOF) {
+    ungetc(first, infile);
+  }
+  if (first == RSA_LZ_MAGIC[0]) {
+    char magic[8];
+    if (fgets(magic, sizeof(magic), infile) == NULL ||
+        strcmp(magic, RSA_LZ_MAGIC "\n") != 0) {
+      return false;
+    }
+    STATS_ADD(RSA_STAT_BYTES_READ, strlen(magic));
+    // decrypt the compressed stream to a scratch file, then expand it
+    FILE *packed = tmpfile();
+    if (packed == NULL) {
+      return false;
+    }
+    bool ok = decrypt_stream(infile, packed, arg);
+    // lz_decompress_file counts the real output, so take back the scratch
+    // bytes counted as written (the counters wrap)
+    STATS_ADD(RSA_STAT_BYTES_WRITTEN, -(uint64_t)ftello(packed));
+    rewind(packed);
+    STATS_TIMER(lap);
+    ok = ok && lz_decompress_file(packed, outfile);
+    STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
+    fclose(packed);
+    return ok;
+  }
+  if (first == RSA_MULTI_MAGIC[0]) {
+    return rsa_decrypt_file_multi(infile, outfile, key->n, key->d);
+  }
+  return rsa_decrypt_file(infile, outfile, key->n, key->d);
+}
 
 int main(int argc, char *argv[]) {
 
   FILE *inputFile = stdin;
   FILE *outputFile = stdout;
+  char *outputPath = NULL;
   char privKeyFile[128] = "rsa.priv";
+  char *inputDir = NULL;
+  char *outputDir = NULL;
+  size_t threads = sysconf(_SC_NPROCESSORS_ONLN);
   char verbose = 0;
+  char stats = 0; // 1: text, 2: json
+  char records = 0;
+  char checkpoint = 0;
+  char resume = 0;
+  char progress = 0;
 
   // 1. getopt() 接command line看要做什麼
   /*
       -i (default: stdin): specifies the input file to decrypt.
       -o (default: stdout): specifies the output file to decrypt.
       -n (default: rsa.priv): specifies the file containing the private key.
+      -I : decrypts every file in this directory instead of -i.
+      -O : the directory the -I outputs are written to, under the same names.
+      -t (default: online CPUs): threads used for -I.
+      -r : record mode, for the output of encrypt -r.
+      --checkpoint : records progress in <outputFile>.ckpt every few seconds.
+      --resume : continues a killed --checkpoint run from <outputFile>.ckpt.
+      --progress : reports progress and throughput to stderr.
       -v : enables verbose output.
+      --stats[=json] : prints counters and phase timings to stderr.
       -h : displays program synopsis and usage.
   */
+  static struct option longOpts[] = {
+      {"stats", optional_argument, NULL, 'S'},
+      {"checkpoint", no_argument, NULL, 'C'},
+      {"resume", no_argument, NULL, 'R'},
+      {"progress", no_argument, NULL, 'P'},
+      {NULL, 0, NULL, 0}};
   int cmdOpt; // output of getopt
-  while ((cmdOpt = getopt(argc, argv, "i:o:n:vh")) != -1) {
+  while ((cmdOpt = getopt_long(argc, argv, "i:o:n:I:O:t:rvh", longOpts,
+                               NULL)) != -1) {
     switch (cmdOpt) {
     case 'i':
       inputFile = fopen(optarg, "r");
       break;
     case 'o':
-      outputFile = fopen(optarg, "w");
+      outputPath = optarg;
       break;
     case 'n':
       memset(privKeyFile, '\0', 128);
       strcpy(privKeyFile, optarg);
       break;
+    case 'I':
+      inputDir = optarg;
+      break;
+    case 'O':
+      outputDir = optarg;
+      break;
+    case 't':
+      threads = strtoul(optarg, NULL, 10);
+      break;
+    case 'r':
+      records = 1;
+      break;
     case 'v':
       verbose = 1;
       break;
+    case 'S':
+      stats = (optarg != NULL && strcmp(optarg, "json") == 0) ? 2 : 1;
+      break;
+    case 'C':
+      checkpoint = 1;
+      break;
+    case 'R':
+      resume = 1;
+      break;
+    case 'P':
+      progress = 1;
+      break;
     case 'h':
       fprintf(stderr, "[SYNOPSIS]\n");
       fprintf(stderr, "The program decrypts the data by the private key.\n\n");
       fprintf(stderr, "[Usage]\n");
       fprintf(stderr,
-              "./decrypt [-i inputFile] [-o outputFile] [-n privfile] [-vh]\n");
+              "./decrypt [-i inputFile] [-o outputFile] [-n privfile] "
+              "[-I inDir -O outDir] [-t threads] [--stats[=json]] "
+              "[--checkpoint] [--resume] [--progress] [-rvh]\n");
       fprintf(stderr,
               "-i (default: stdin): specifies the input file to decrypt.\n");
       fprintf(stderr,
               "-o (default: stdout): specifies the output file to decrypt.\n");
       fprintf(stderr, "-n (default: rsa.priv): specifies the file containing "
                       "the private key.\n");
+      fprintf(stderr, "-I : decrypts every file in this directory, loading "
+                      "the key once.\n");
+      fprintf(stderr, "-O : the directory to write the -I outputs to, under "
+                      "the same names.\n");
+      fprintf(stderr, "-t (default: online CPUs): threads used for -I.\n");
+      fprintf(stderr, "-r : record mode, decrypts the output of encrypt -r "
+                      "and flushes every record as it completes.\n");
+      fprintf(stderr, "--checkpoint : records progress in <outputFile>.ckpt "
+                      "every few seconds.\n");
+      fprintf(stderr, "--resume : continues a killed --checkpoint run from "
+                      "<outputFile>.ckpt.\n");
+      fprintf(stderr,
+              "--progress : reports progress and throughput to stderr.\n");
       fprintf(stderr, "-v : enables verbose output.\n");
+      fprintf(stderr, "--stats[=json] : prints counters and phase timings "
+                      "to stderr.\n");
       fprintf(stderr, "-h : displays program synopsis and usage.\n");
       return 0;
       break;
@@ -58,14 +171,59 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (inputDir != NULL && outputDir == NULL) {
+    fprintf(stderr, "-I requires -O\n");
+    return 1;
+  }
+
+  if (records && inputDir != NULL) {
+    fprintf(stderr, "-r cannot be used with -I\n");
+    return 1;
+  }
+
+  // long single-key jobs can be watched, checkpointed and resumed
+  bool longJob = checkpoint || resume || progress;
+  if (longJob && (inputDir != NULL || records)) {
+    fprintf(stderr,
+            "--checkpoint, --resume and --progress cannot be used with -I "
+            "or -r\n");
+    return 1;
+  }
+  if ((checkpoint || resume) && (outputPath == NULL || inputFile == stdin)) {
+    fprintf(stderr, "--checkpoint and --resume need -i and -o files\n");
+    return 1;
+  }
+
+  // resuming continues the existing output instead of truncating it
+  if (outputPath != NULL &&
+      (outputFile = fopen(outputPath, resume ? "r+" : "w")) == NULL) {
+    fprintf(stderr, "cannot open output %s\n", outputPath);
+    return 1;
+  }
+  char *ckpath = NULL;
+  if (checkpoint || resume) {
+    size_t len = strlen(outputPath) + sizeof(".ckpt");
+    ckpath = (char *)malloc(len);
+    snprintf(ckpath, len, "%s.ckpt", outputPath);
+  }
+
   // 2. fopen() private key 記得例外處理
+  STATS_TIMER(lap);
   FILE *privKey;
   privKey = fopen(privKeyFile, "r");
 
   // 3. read the key
-  mpz_t n, d;
-  mpz_inits(n, d, NULL);
-  rsa_read_priv(n, d, privKey);
+  privkey_t key;
+  mpz_inits(key.n, key.d, NULL);
+  int status = 0;
+  if (privKey == NULL) {
+    fprintf(stderr, "cannot open private key %s\n", privKeyFile);
+    status = 1;
+  } else if (!rsa_read_priv(key.n, key.d, privKey)) {
+    fprintf(stderr, "malformed private key %s\n", privKeyFile);
+    status = 1;
+  }
+  STATS_LAP(RSA_STAT_KEY_LOAD_NS, lap);
 
   // 4. if -v print the following to stderr
   /*
@@ -74,20 +232,76 @@ int main(int argc, char *argv[]) {
   */
   size_t numbits;
   if (verbose == true) {
-    numbits = mpz_sizeinbase(n, 2);
-    gmp_printf("n (%d bits) = %Zd\n", numbits, n);
-    numbits = mpz_sizeinbase(d, 2);
-    gmp_printf("d (%d bits) = %Zd\n", numbits, d);
+    numbits = mpz_sizeinbase(key.n, 2);
+    gmp_printf("n (%d bits) = %Zd\n", numbits, key.n);
+    numbits = mpz_sizeinbase(key.d, 2);
+    gmp_printf("d (%d bits) = %Zd\n", numbits, key.d);
   }
 
-  // 5. decrypt the file using rsa_decrypt_file()
-  rsa_decrypt_file(inputFile, outputFile, n, d);
+  // 5. decrypt the file using rsa_decrypt_file(), or find this key's entry in
+  // a multi-recipient file. With -I every file of the directory reuses the
+  // key loaded above.
+  if (status != 0) {
+    // the key could not be loaded; nothing to decrypt with
+  } else if (inputDir != NULL) {
+    size_t failed =
+        batch_run(inputDir, outputDir, threads, decrypt_stream, &key);
+    if (failed == SIZE_MAX) {
+      fprintf(stderr, "cannot read directory %s\n", inputDir);
+      status = 1;
+    } else if (failed == BATCH_SAME_DIR) {
+      fprintf(stderr, "-O must not be the -I directory\n");
+      status = 1;
+    } else if (failed > 0) {
+      fprintf(stderr, "%zu files failed\n", failed);
+      status = 1;
+    }
+  } else if (records) {
+    if (!rsa_decrypt_records(inputFile, outputFile, key.n, key.d)) {
+      fprintf(stderr, "malformed record\n");
+      status = 1;
+    }
+  } else if (longJob) {
+    // only plain single-key files are a flat run of blocks that can be
+    // resumed at a block boundary
+    int first = fgetc(inputFile);
+    if (first != EOF) {
+      ungetc(first, inputFile);
+    }
+    if (first == RSA_LZ_MAGIC[0] || first == RSA_MULTI_MAGIC[0]) {
+      fprintf(stderr, "--checkpoint, --resume and --progress need a file "
+                      "encrypted for a single key without -z\n");
+      status = 1;
+    } else if (!rsa_decrypt_file_ckpt(inputFile, outputFile, key.n, key.d,
+                                      ckpath, resume, progress)) {
+      if (ckpath == NULL) {
+        fprintf(stderr, "cannot decrypt: corrupt input\n");
+      } else {
+        fprintf(stderr, "cannot decrypt, or %s checkpoint %s\n",
+                resume ? "resume from" : "write", ckpath);
+      }
+      status = 1;
+    }
+  } else if (!decrypt_stream(inputFile, outputFile, &key)) {
+    fprintf(stderr, "cannot decrypt: no session key for this private key "
+                    "or corrupt input\n");
+    status = 1;
+  }
 
   // 6. close the private key file and clear any mpz_t variables you have used
-  mpz_clears(n, d, NULL);
+  mpz_clears(key.n, key.d, NULL);
+  STATS_TIMER(closing);
   fclose(inputFile);
   fclose(outputFile);
-  fclose(privKey);
+  if (privKey != NULL) {
+    fclose(privKey);
+  }
+  STATS_LAP(RSA_STAT_IO_NS, closing);
+  free(ckpath);
+
+  if (stats) {
+    rsa_stats_print(stderr, stats == 2);
+  }
 
-  return 0;
+  return status;
 }
@@ -1,56 +1,180 @@
 
+#include <getopt.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "batch.h"
+#include "lz.h"
 #include "numtheory.h"
 #include "randstate.h"
 #include "rsa.h"
+#include "stats.h"
+
+// the loaded public keys, shared read-only by every file of a batch
+typedef struct {
+  mpz_t *n;
+  mpz_t *e;
+  size_t recipients;
+  bool compress;
+} recipients_t;
+
+static bool encrypt_blocks(FILE *infile, FILE *outfile, recipients_t *keys) {
+  if (keys->recipients == 1) {
+    rsa_encrypt_file(infile, outfile, keys->n[0], keys->e[0]);
+    return true;
+  }
+  return rsa_encrypt_file_multi(infile, outfile, keys->n, keys->e,
+                                keys->recipients);
+}
+
+static bool encrypt_stream(FILE *infile, FILE *outfile, void *arg) {
+  recipients_t *keys = (recipients_t *)arg;
+  if (!keys->compress) {
+    return encrypt_blocks(infile, outfile, keys);
+  }
+
+  // compress into a scratch file, then encrypt that behind the marker line;
+  // every block saved here is one modexp saved
+  FILE *packed = tmpfile();
+  if (packed == NULL) {
+    return false;
+  }
+  STATS_TIMER(lap);
+  lz_compress_file(infile, packed);
+  rewind(packed);
+  STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
+  int written = fprintf(outfile, "%s\n", RSA_LZ_MAGIC);
+  STATS_ADD(RSA_STAT_BYTES_WRITTEN, written);
+  bool ok = encrypt_blocks(packed, outfile, keys);
+  // lz_compress_file already counted the real input, so take back the
+  // scratch bytes encrypt_blocks counted as read (the counters wrap)
+  STATS_ADD(RSA_STAT_BYTES_READ, -(uint64_t)ftello(packed));
+  fclose(packed);
+  return ok;
+}
 
 int main(int argc, char *argv[]) {
 
   FILE *inputFile = stdin;
   FILE *outputFile = stdout;
-  char pubKeyFile[128] = "rsa.pub";
+  char *outputPath = NULL;
+  // every -n adds a recipient; argv outlives main's use of these pointers
+  char **pubKeyFiles = (char **)calloc(argc, sizeof(char *));
+  size_t recipients = 0;
+  char *inputDir = NULL;
+  char *outputDir = NULL;
+  size_t threads = sysconf(_SC_NPROCESSORS_ONLN);
   char verbose = 0;
+  char stats = 0; // 1: text, 2: json
+  char records = 0;
+  char compress = 0;
+  char checkpoint = 0;
+  char resume = 0;
+  char progress = 0;
 
   // 1. getopt() 接command line看要做什麼
   /*
       -i (default: stdin): specifies the input file to encrypt.
       -o (default: stdout): specifies the output file to encrypt.
       -n (default: rsa.pub): specifies the file containing the public key.
+                             Repeat to encrypt once for several recipients.
+      -I : encrypts every file in this directory instead of -i.
+      -O : the directory the -I outputs are written to, under the same names.
+      -t (default: online CPUs): threads used for -I.
+      -r : record mode, each input line is encrypted and flushed on its own.
+      -z : compresses the input before encrypting it.
+      --checkpoint : records progress in <outputFile>.ckpt every few seconds.
+      --resume : continues a killed --checkpoint run from <outputFile>.ckpt.
+      --progress : reports progress and throughput to stderr.
       -v : enables verbose output.
+      --stats[=json] : prints counters and phase timings to stderr.
       -h : displays program synopsis and usage.
   */
+  static struct option longOpts[] = {
+      {"stats", optional_argument, NULL, 'S'},
+      {"checkpoint", no_argument, NULL, 'C'},
+      {"resume", no_argument, NULL, 'R'},
+      {"progress", no_argument, NULL, 'P'},
+      {NULL, 0, NULL, 0}};
   int cmdOpt; // output of getopt
-  while ((cmdOpt = getopt(argc, argv, "i:o:n:vh")) != -1) {
+  while ((cmdOpt = getopt_long(argc, argv, "i:o:n:I:O:t:rzvh", longOpts,
+                               NULL)) != -1) {
     switch (cmdOpt) {
     case 'i':
       inputFile = fopen(optarg, "r");
       break;
     case 'o':
-      outputFile = fopen(optarg, "w");
+      outputPath = optarg;
       break;
     case 'n':
-      memset(pubKeyFile, '\0', 128);
-      strcpy(pubKeyFile, optarg);
+      pubKeyFiles[recipients++] = optarg;
+      break;
+    case 'I':
+      inputDir = optarg;
+      break;
+    case 'O':
+      outputDir = optarg;
+      break;
+    case 't':
+      threads = strtoul(optarg, NULL, 10);
+      break;
+    case 'r':
+      records = 1;
+      break;
+    case 'z':
+      compress = 1;
       break;
     case 'v':
       verbose = 1;
       break;
+    case 'S':
+      stats = (optarg != NULL && strcmp(optarg, "json") == 0) ? 2 : 1;
+      break;
+    case 'C':
+      checkpoint = 1;
+      break;
+    case 'R':
+      resume = 1;
+      break;
+    case 'P':
+      progress = 1;
+      break;
     case 'h':
       fprintf(stderr, "[SYNOPSIS]\n");
       fprintf(stderr, "The program encrypts the data by the public key.\n\n");
       fprintf(stderr, "[Usage]\n");
       fprintf(stderr,
-              "./encrypt [-i inputFile] [-o outputFile] [-n pubfile] [-vh]\n");
+              "./encrypt [-i inputFile] [-o outputFile] [-n pubfile]... "
+              "[-I inDir -O outDir] [-t threads] [--stats[=json]] "
+              "[--checkpoint] [--resume] [--progress] [-rzvh]\n");
       fprintf(stderr,
               "-i (default: stdin): specifies the input file to encrypt.\n");
       fprintf(stderr,
               "-o (default: stdout): specifies the output file to encrypt.\n");
       fprintf(stderr, "-n (default: rsa.pub): specifies the file containing "
                       "the public key.\n");
+      fprintf(stderr, "   Repeat -n to encrypt the input once for several "
+                      "recipients.\n");
+      fprintf(stderr, "-I : encrypts every file in this directory, loading "
+                      "and verifying the keys once.\n");
+      fprintf(stderr, "-O : the directory to write the -I outputs to, under "
+                      "the same names.\n");
+      fprintf(stderr, "-t (default: online CPUs): threads used for -I.\n");
+      fprintf(stderr, "-r : record mode, encrypts and flushes every input "
+                      "line on its own as a length-prefixed record.\n");
+      fprintf(stderr, "-z : compresses the input before encrypting it; "
+                      "decrypt detects this by itself.\n");
+      fprintf(stderr, "--checkpoint : records progress in <outputFile>.ckpt "
+                      "every few seconds.\n");
+      fprintf(stderr, "--resume : continues a killed --checkpoint run from "
+                      "<outputFile>.ckpt.\n");
+      fprintf(stderr,
+              "--progress : reports progress and throughput to stderr.\n");
       fprintf(stderr, "-v : enables verbose output.\n");
+      fprintf(stderr, "--stats[=json] : prints counters and phase timings "
+                      "to stderr.\n");
       fprintf(stderr, "-h : displays program synopsis and usage.\n");
+      free(pubKeyFiles);
       return 0;
       break;
     case '?':
@@ -59,58 +183,164 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  // 2. fopen() public key 記得例外處理
-  FILE *pubKey;
-  pubKey = fopen(pubKeyFile, "r");
+  if (inputDir != NULL && outputDir == NULL) {
+    fprintf(stderr, "-I requires -O\n");
+    free(pubKeyFiles);
+    return 1;
+  }
 
-  // 3. read the key
-  mpz_t n, e, s;
-  mpz_inits(n, e, s, NULL);
-  char userName[65536];
-  rsa_read_pub(n, e, s, userName, pubKey);
+  if (recipients == 0) {
+    pubKeyFiles[recipients++] = "rsa.pub";
+  }
 
-  // 4. if -v print the following to stderr
-  /*
-      (a) username \n
-      (b) the signature s \n
-      (c) the public modulus n \n
-      (d) the public exponent e \n
-  */
-  size_t numbits;
-  if (verbose == true) {
-    gmp_printf("user = %s\n", userName);
-    numbits = mpz_sizeinbase(s, 2);
-    gmp_printf("s (%d bits) = %Zd\n", numbits, s);
-    numbits = mpz_sizeinbase(n, 2);
-    gmp_printf("n (%d bits) = %Zd\n", numbits, n);
-    numbits = mpz_sizeinbase(e, 2);
-    gmp_printf("e (%d bits) = %Zd\n", numbits, e);
+  if (records && (recipients > 1 || inputDir != NULL || compress)) {
+    fprintf(stderr, "-r takes a single -n and cannot be used with -I or -z\n");
+    free(pubKeyFiles);
+    return 1;
   }
 
-  // 5. convert the username that was read in to an mpz_t. This will be the
-  // expected value of the verified
-  //    signature. Verify the signature using rsa_verify(), reporting an error
-  //    and exiting the program if the signature couldn’t be verified
-  mpz_t m;
-  mpz_inits(m, NULL);
-  mpz_set_str(m, userName, 62);
-  if (rsa_verify(m, s, e, n) == false) {
-    gmp_printf("invalid singature\n");
-    fclose(inputFile);
-    fclose(outputFile);
+  // long single-key jobs can be watched, checkpointed and resumed
+  bool longJob = checkpoint || resume || progress;
+  if (longJob && (recipients > 1 || inputDir != NULL || records || compress)) {
+    fprintf(stderr, "--checkpoint, --resume and --progress take a single -n "
+                    "and cannot be used with -I, -r or -z\n");
+    free(pubKeyFiles);
+    return 1;
+  }
+  if ((checkpoint || resume) && (outputPath == NULL || inputFile == stdin)) {
+    fprintf(stderr, "--checkpoint and --resume need -i and -o files\n");
+    free(pubKeyFiles);
+    return 1;
+  }
+
+  // resuming continues the existing output instead of truncating it
+  if (outputPath != NULL &&
+      (outputFile = fopen(outputPath, resume ? "r+" : "w")) == NULL) {
+    fprintf(stderr, "cannot open output %s\n", outputPath);
+    free(pubKeyFiles);
+    return 1;
+  }
+  char *ckpath = NULL;
+  if (checkpoint || resume) {
+    size_t len = strlen(outputPath) + sizeof(".ckpt");
+    ckpath = (char *)malloc(len);
+    snprintf(ckpath, len, "%s.ckpt", outputPath);
+  }
+
+  mpz_t *n = (mpz_t *)malloc(recipients * sizeof(mpz_t));
+  mpz_t *e = (mpz_t *)malloc(recipients * sizeof(mpz_t));
+  mpz_t s, m;
+  mpz_inits(s, m, NULL);
+  char userName[65536];
+  int status = 0;
+
+  size_t loaded = 0;
+  for (; loaded < recipients; loaded++) {
+    STATS_TIMER(lap);
+    // 2. fopen() public key 記得例外處理
+    FILE *pubKey = fopen(pubKeyFiles[loaded], "r");
+    if (pubKey == NULL) {
+      fprintf(stderr, "cannot open public key %s\n", pubKeyFiles[loaded]);
+      status = 1;
+      break;
+    }
+
+    // 3. read the key
+    mpz_inits(n[loaded], e[loaded], NULL);
+    bool valid = rsa_read_pub(n[loaded], e[loaded], s, userName, pubKey);
     fclose(pubKey);
-    mpz_clears(n, e, s, NULL);
-    return 0;
+    STATS_LAP(RSA_STAT_KEY_LOAD_NS, lap);
+    if (!valid) {
+      fprintf(stderr, "malformed public key %s\n", pubKeyFiles[loaded]);
+      status = 1;
+      loaded++;
+      break;
+    }
+
+    // 4. if -v print the following to stderr
+    /*
+        (a) username \n
+        (b) the signature s \n
+        (c) the public modulus n \n
+        (d) the public exponent e \n
+    */
+    size_t numbits;
+    if (verbose == true) {
+      gmp_printf("user = %s\n", userName);
+      numbits = mpz_sizeinbase(s, 2);
+      gmp_printf("s (%d bits) = %Zd\n", numbits, s);
+      numbits = mpz_sizeinbase(n[loaded], 2);
+      gmp_printf("n (%d bits) = %Zd\n", numbits, n[loaded]);
+      numbits = mpz_sizeinbase(e[loaded], 2);
+      gmp_printf("e (%d bits) = %Zd\n", numbits, e[loaded]);
+    }
+
+    // 5. convert the username that was read in to an mpz_t. This will be the
+    // expected value of the verified
+    //    signature. Verify the signature using rsa_verify(), reporting an
+    //    error and exiting the program if the signature couldn’t be verified
+    mpz_set_str(m, userName, 62);
+    STATS_LAP(RSA_STAT_IO_NS, lap);
+    valid = rsa_verify(m, s, e[loaded], n[loaded]);
+    STATS_LAP(RSA_STAT_VERIFY_NS, lap);
+    if (valid == false) {
+      fprintf(stderr, "invalid signature in %s\n", pubKeyFiles[loaded]);
+      status = 1;
+      loaded++;
+      break;
+    }
   }
 
-  // 6. encrypt the file using rsa_encrypt_file()
-  rsa_encrypt_file(inputFile, outputFile, n, e);
+  // 6. encrypt the file using rsa_encrypt_file(), or wrap one session key per
+  // recipient with rsa_encrypt_file_multi(). With -I every file of the
+  // directory reuses the keys loaded and verified above.
+  recipients_t keys = {n, e, recipients, compress};
+  if (loaded == recipients && status == 0) {
+    if (inputDir != NULL) {
+      size_t failed =
+          batch_run(inputDir, outputDir, threads, encrypt_stream, &keys);
+      if (failed == SIZE_MAX) {
+        fprintf(stderr, "cannot read directory %s\n", inputDir);
+        status = 1;
+      } else if (failed == BATCH_SAME_DIR) {
+        fprintf(stderr, "-O must not be the -I directory\n");
+        status = 1;
+      } else if (failed > 0) {
+        fprintf(stderr, "%zu files failed\n", failed);
+        status = 1;
+      }
+    } else if (records) {
+      rsa_encrypt_records(inputFile, outputFile, n[0], e[0]);
+    } else if (longJob) {
+      if (!rsa_encrypt_file_ckpt(inputFile, outputFile, n[0], e[0], ckpath,
+                                 resume, progress)) {
+        fprintf(stderr, "cannot %s checkpoint %s\n",
+                resume ? "resume from" : "write", ckpath);
+        status = 1;
+      }
+    } else if (!encrypt_stream(inputFile, outputFile, &keys)) {
+      fprintf(stderr, "cannot wrap the session key for every recipient\n");
+      status = 1;
+    }
+  }
+  STATS_TIMER(closing);
   fclose(inputFile);
   fclose(outputFile);
-  fclose(pubKey);
+  STATS_LAP(RSA_STAT_IO_NS, closing);
 
-  // 7. close the public key file and clear any mpz_t variables
-  mpz_clears(n, e, s, m, NULL);
+  if (stats) {
+    rsa_stats_print(stderr, stats == 2);
+  }
+
+  // 7. clear any mpz_t variables
+  for (size_t i = 0; i < loaded; i++) {
+    mpz_clears(n[i], e[i], NULL);
+  }
+  mpz_clears(s, m, NULL);
+  free(n);
+  free(e);
+  free(pubKeyFiles);
+  free(ckpath);
 
-  return 0;
+  return status;
 }
@@ -0,0 +1,250 @@
+#include <getopt.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batchgcd.h"
+#include "numtheory.h"
+#include "rsa.h"
+#include "stats.h"
+
+// a key index ordered by a number: its modulus, or a prime it shares
+typedef struct {
+  mpz_ptr v;
+  size_t i;
+} keyed_t;
+
+static int by_value(const void *a, const void *b) {
+  const keyed_t *x = (const keyed_t *)a;
+  const keyed_t *y = (const keyed_t *)b;
+  int c = mpz_cmp(x->v, y->v);
+  return (c != 0) ? c : (x->i > y->i) - (x->i < y->i);
+}
+
+// print every key of each run with an equal value against the run's first key
+static void print_runs(keyed_t *keyed, size_t count, char **names) {
+  qsort(keyed, count, sizeof(keyed_t), by_value);
+  for (size_t k = 0, start = 0; k < count; k++) {
+    if (mpz_cmp(keyed[k].v, keyed[start].v) != 0) {
+      start = k;
+    } else if (k > start) {
+      printf("%s and %s share a factor\n", names[keyed[start].i],
+             names[keyed[k].i]);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t threads = sysconf(_SC_NPROCESSORS_ONLN);
+  char verbose = 0;
+  char stats = 0; // 1: text, 2: json
+
+  // 1. getopt() 接command line看要做什麼
+  /*
+      -t (default: online CPUs): threads used per tree level.
+      -v : enables verbose output.
+      -h : displays program synopsis and usage.
+      --stats[=json] : prints counters and phase timings to stderr.
+      the remaining arguments are the public key files to audit.
+      exit status 2 means at least one key shares a factor.
+  */
+  static struct option longOpts[] = {
+      {"stats", optional_argument, NULL, 'S'}, {NULL, 0, NULL, 0}};
+  int cmdOpt; // output of getopt
+  while ((cmdOpt = getopt_long(argc, argv, "t:vh", longOpts, NULL)) != -1) {
+    switch (cmdOpt) {
+    case 't':
+      threads = strtoul(optarg, NULL, 10);
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    case 'S':
+      stats = (optarg != NULL && strcmp(optarg, "json") == 0) ? 2 : 1;
+      break;
+    case 'h':
+      fprintf(stderr, "[SYNOPSIS]\n");
+      fprintf(stderr, "The program finds public keys whose moduli share a "
+                      "prime factor.\n\n");
+      fprintf(stderr, "[Usage]\n");
+      fprintf(stderr, "./keyaudit [-t threads] [--stats[=json]] [-vh] "
+                      "pubfile...\n");
+      fprintf(stderr,
+              "-t (default: online CPUs): threads used per tree level.\n");
+      fprintf(stderr, "-v : enables verbose output.\n");
+      fprintf(stderr, "-h : displays program synopsis and usage.\n");
+      fprintf(stderr, "--stats[=json] : prints counters and phase timings "
+                      "to stderr.\n");
+      fprintf(stderr, "Exits with status 2 if any key shares a factor.\n");
+      return 0;
+      break;
+    case '?':
+      printf("Unknown option: %c\n", (char)optopt);
+      break;
+    }
+  }
+
+  // 2. read the modulus of every public key given
+  size_t files = argc - optind;
+  char **names = (char **)malloc((files + 1) * sizeof(char *));
+  mpz_t *n = (mpz_t *)malloc((files + 1) * sizeof(mpz_t));
+  mpz_t *g = (mpz_t *)malloc((files + 1) * sizeof(mpz_t));
+  mpz_t e, s;
+  mpz_inits(e, s, NULL);
+  char userName[65536];
+  int status = 0;
+
+  STATS_TIMER(lap);
+  size_t count = 0;
+  for (int i = optind; i < argc; i++) {
+    FILE *pubKey = fopen(argv[i], "r");
+    if (pubKey == NULL) {
+      fprintf(stderr, "cannot open public key %s\n", argv[i]);
+      status = 1;
+      continue;
+    }
+    mpz_init(n[count]);
+    bool valid = rsa_read_pub(n[count], e, s, userName, pubKey);
+    fclose(pubKey);
+    // a zero modulus would divide by zero in the remainder tree
+    if (!valid) {
+      fprintf(stderr, "malformed public key %s\n", argv[i]);
+      mpz_clear(n[count]);
+      status = 1;
+      continue;
+    }
+    names[count++] = argv[i];
+  }
+  STATS_LAP(RSA_STAT_KEY_LOAD_NS, lap);
+
+  // 3. group identical moduli: a repeated key is the usual result of weak
+  // seeding, and every copy would otherwise look fully shared
+  keyed_t *keyed = (keyed_t *)malloc((2 * count + 1) * sizeof(keyed_t));
+  size_t *slot = (size_t *)malloc((count + 1) * sizeof(size_t));
+  size_t *first = (size_t *)malloc((count + 1) * sizeof(size_t));
+  size_t *copies = (size_t *)calloc(count + 1, sizeof(size_t));
+  mpz_t *dn = (mpz_t *)malloc((count + 1) * sizeof(mpz_t));
+  for (size_t i = 0; i < count; i++) {
+    keyed[i] = (keyed_t){n[i], i};
+  }
+  qsort(keyed, count, sizeof(keyed_t), by_value);
+  size_t moduli = 0;
+  for (size_t k = 0; k < count; k++) {
+    size_t i = keyed[k].i;
+    if (k == 0 || mpz_cmp(n[i], keyed[k - 1].v) != 0) {
+      // a read-only alias of n[i], so nothing to clear
+      mpz_roinit_n(dn[moduli], mpz_limbs_read(n[i]), mpz_size(n[i]));
+      mpz_init(g[moduli]);
+      first[moduli++] = i;
+    }
+    slot[i] = moduli - 1;
+    copies[moduli - 1]++;
+  }
+
+  // 4. one batch gcd over the distinct moduli
+  batch_gcd(g, dn, moduli, threads);
+  STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
+
+  // 5. report every weak key: a copy of another key, or one whose modulus
+  // shares a prime with a different modulus
+  size_t weak = 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t k = slot[i];
+    if (copies[k] > 1 || mpz_cmp(g[k], n[i]) == 0) {
+      printf("%s: every factor is shared\n", names[i]);
+    } else if (mpz_cmp_ui(g[k], 1) != 0) {
+      gmp_printf("%s: shares factor %Zx\n", names[i], g[k]);
+    } else {
+      continue;
+    }
+    weak++;
+  }
+
+  // 6. pair the weak keys up by sorting, not by a gcd per pair, since weak
+  // seeding can leave thousands of them. Copies pair with the first key of
+  // their modulus.
+  for (size_t i = 0; i < count; i++) {
+    if (first[slot[i]] != i) {
+      printf("%s and %s share a factor\n", names[first[slot[i]]], names[i]);
+    }
+  }
+
+  // A modulus with 1 < g < n shares exactly one prime, g itself, so moduli
+  // sorted by g sit next to the others sharing their prime.
+  mpz_t *primes = (mpz_t *)malloc((2 * moduli + 1) * sizeof(mpz_t));
+  size_t found = 0;
+  mpz_t known, d;
+  mpz_init_set_ui(known, 1);
+  mpz_init(d);
+  for (size_t k = 0; k < moduli; k++) {
+    if (mpz_cmp_ui(g[k], 1) != 0 && mpz_cmp(g[k], dn[k]) != 0) {
+      mpz_init_set(primes[found], g[k]);
+      keyed[found] = (keyed_t){primes[found], first[k]};
+      mpz_mul(known, known, g[k]);
+      found++;
+    }
+  }
+
+  // With g == n both primes are reused. Each one is either among the primes
+  // above or shared only with other such moduli, which weak seeding rarely
+  // produces, so finding one prime of these is allowed to cost more.
+  size_t single = found;
+  for (size_t k = 0; k < moduli; k++) {
+    if (mpz_cmp(g[k], dn[k]) != 0) {
+      continue;
+    }
+    gcd(d, dn[k], known);
+    for (size_t p = 0; p < single && mpz_cmp(d, dn[k]) == 0; p++) {
+      if (mpz_divisible_p(dn[k], primes[p])) {
+        mpz_set(d, primes[p]);
+      }
+    }
+    for (size_t o = 0; o < moduli && mpz_cmp_ui(d, 1) == 0; o++) {
+      if (o != k && mpz_cmp(g[o], dn[o]) == 0) {
+        gcd(d, dn[k], dn[o]);
+      }
+    }
+    if (mpz_cmp_ui(d, 1) == 0) {
+      continue;
+    }
+    mpz_init_set(primes[found], d);
+    keyed[found] = (keyed_t){primes[found], first[k]};
+    found++;
+    mpz_init(primes[found]);
+    mpz_divexact(primes[found], dn[k], d);
+    keyed[found] = (keyed_t){primes[found], first[k]};
+    found++;
+  }
+  print_runs(keyed, found, names);
+  STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
+
+  if (verbose == true) {
+    fprintf(stderr, "%zu keys audited, %zu weak\n", count, weak);
+  }
+  if (stats) {
+    rsa_stats_print(stderr, stats == 2);
+  }
+
+  // 5. clear any mpz_t variables
+  for (size_t i = 0; i < count; i++) {
+    mpz_clear(n[i]);
+  }
+  for (size_t k = 0; k < moduli; k++) {
+    mpz_clear(g[k]);
+  }
+  for (size_t p = 0; p < found; p++) {
+    mpz_clear(primes[p]);
+  }
+  mpz_clears(e, s, known, d, NULL);
+  free(keyed);
+  free(slot);
+  free(first);
+  free(copies);
+  free(dn);
+  free(primes);
+  free(names);
+  free(n);
+  free(g);
+
+  return (weak > 0) ? 2 : status;
+}
@@ -1,3 +1,4 @@
+#include <getopt.h>
 #include <gmp.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,6 +9,7 @@
 
 #include "randstate.h"
 #include "rsa.h"
+#include "stats.h"
 
 int main(int argc, char *argv[]) {
 
@@ -17,6 +19,7 @@ int main(int argc, char *argv[]) {
   char privKeyFile[128] = "rsa.priv";
   uint64_t timeSeed = time(NULL);
   char verbose = 0;
+  char stats = 0; // 1: text, 2: json
 
   // 1. getopt() 接command line看要做什麼
   /*
@@ -29,11 +32,15 @@ int main(int argc, char *argv[]) {
       -s (default: time seed): specifies the random seed for
                                the random state initialization.
       -v : enables verbose output.
+      --stats[=json] : prints counters and phase timings to stderr.
       -h : displays program synopsis and usage.
   */
   int cmdOpt; // output of getopt
   char *ptr;  // for strtoull
-  while ((cmdOpt = getopt(argc, argv, "b:i:n:d:s:vh")) != -1) {
+  static struct option longOpts[] = {
+      {"stats", optional_argument, NULL, 'S'}, {NULL, 0, NULL, 0}};
+  while ((cmdOpt = getopt_long(argc, argv, "b:i:n:d:s:vh", longOpts, NULL)) !=
+         -1) {
     switch (cmdOpt) {
     case 'b':
       nbits = atoi(optarg);
@@ -57,6 +64,9 @@ int main(int argc, char *argv[]) {
     case 'v':
       verbose = 1;
       break;
+    case 'S':
+      stats = (optarg != NULL && strcmp(optarg, "json") == 0) ? 2 : 1;
+      break;
     case 'h':
       fprintf(stderr, "[SYNOPSIS]\n");
       fprintf(stderr,
@@ -64,7 +74,7 @@ int main(int argc, char *argv[]) {
       fprintf(stderr, "[Usage]\n");
       fprintf(stderr,
               "./keygen [-b bits] [-i iters] [-n pubfile] [-d privfile] [-s "
-              "timeSeed] [-vh]\n");
+              "timeSeed] [--stats[=json]] [-vh]\n");
       fprintf(stderr,
               "-b (default 1024): specifies the minimum bits needed for the "
               "public modulus n.\n");
@@ -78,6 +88,8 @@ int main(int argc, char *argv[]) {
               "-s (default: time seed): specifies the random seed for the "
               "random state initialization.\n");
       fprintf(stderr, "-v : enables verbose output.\n");
+      fprintf(stderr, "--stats[=json] : prints counters and phase timings "
+                      "to stderr.\n");
       fprintf(stderr, "-h : displays program synopsis and usage.\n");
       return 0;
       break;
@@ -103,6 +115,7 @@ int main(int argc, char *argv[]) {
   randstate_init(timeSeed);
 
   // 5. rsa_make_pub() rsa_make_priv()
+  STATS_TIMER(lap);
   mpz_t p, q, n, e, d; // prime num: p, q; product of pq: n; public exponent: e
   mpz_inits(p, q, n, e, NULL);
   rsa_make_pub(p, q, n, e, nbits, iters);
@@ -118,10 +131,12 @@ int main(int argc, char *argv[]) {
   mpz_inits(m, s, NULL);
   mpz_set_str(m, userName, 62);
   rsa_sign(s, m, d, n);
+  STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
 
   // 8. write the computed public and private key to their respective files
   rsa_write_pub(n, e, s, userName, pubKey);
   rsa_write_priv(n, d, privKey);
+  STATS_LAP(RSA_STAT_IO_NS, lap);
 
   // 9. if -v print the following to stderr
   /*
@@ -152,8 +167,15 @@ int main(int argc, char *argv[]) {
 
   // 10. Close the public and private key files, randstate_clear(), and clear
   // any mpz_t variables you may have used.
+  STATS_TIMER(closing);
   fclose(pubKey);
   fclose(privKey);
+  STATS_LAP(RSA_STAT_IO_NS, closing);
+
+  if (stats) {
+    rsa_stats_print(stderr, stats == 2);
+  }
+
   mpz_clears(p, q, n, e, d, m, s, NULL);
   randstate_clear();
   return 0;
@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+#include "stats.h"
+
+#define LZ_CHUNK 65536
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+
+// worst case: every byte a literal, plus length extension bytes
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+static uint32_t hash4(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// lengths of 15 and above continue in 255-valued extension bytes
+static size_t put_length(uint8_t *out, size_t len) {
+  size_t o = 0;
+  while (len >= 255) {
+    out[o++] = 255;
+    len -= 255;
+  }
+  out[o++] = (uint8_t)len;
+  return o;
+}
+
+static bool get_length(const uint8_t *in, size_t n, size_t *ip, size_t *len) {
+  uint8_t b;
+  do {
+    if (*ip >= n) {
+      return false;
+    }
+    b = in[(*ip)++];
+    *len += b;
+  } while (b == 255);
+  return true;
+}
+
+// emit nlits literals and, unless final, one match
+static size_t put_sequence(uint8_t *out, const uint8_t *lits, size_t nlits,
+                           size_t offset, size_t mlen, bool final) {
+  size_t o = 1;
+  size_t mcode = final ? 0 : mlen - LZ_MIN_MATCH;
+  out[0] = (uint8_t)(((nlits < 15 ? nlits : 15) << 4) |
+                     (mcode < 15 ? mcode : 15));
+  if (nlits >= 15) {
+    o += put_length(out + o, nlits - 15);
+  }
+  memcpy(out + o, lits, nlits);
+  o += nlits;
+  if (final) {
+    return o;
+  }
+  out[o++] = (uint8_t)offset;
+  out[o++] = (uint8_t)(offset >> 8);
+  if (mcode >= 15) {
+    o += put_length(out + o, mcode - 15);
+  }
+  return o;
+}
+
+// greedy single-probe hash matcher; offsets fit 16 bits within one chunk
+static size_t compress_chunk(const uint8_t *in, size_t n, uint8_t *out,
+                             uint32_t *table) {
+  memset(table, 0, sizeof(uint32_t) << LZ_HASH_BITS);
+  size_t ip = 0, anchor = 0, op = 0;
+
+  while (ip + LZ_MIN_MATCH <= n) {
+    uint32_t h = hash4(in + ip);
+    size_t ref = table[h]; // position + 1, 0 when empty
+    table[h] = (uint32_t)(ip + 1);
+    if (ref == 0 || memcmp(in + ref - 1, in + ip, LZ_MIN_MATCH) != 0) {
+      ip++;
+      continue;
+    }
+    ref--;
+    size_t len = LZ_MIN_MATCH;
+    while (ip + len < n && in[ref + len] == in[ip + len]) {
+      len++;
+    }
+    op += put_sequence(out + op, in + anchor, ip - anchor, ip - ref, len,
+                       false);
+    ip += len;
+    anchor = ip;
+  }
+  op += put_sequence(out + op, in + anchor, n - anchor, 0, 0, true);
+  return op;
+}
+
+static bool decompress_chunk(const uint8_t *in, size_t n, uint8_t *out,
+                             size_t raw) {
+  size_t ip = 0, op = 0;
+
+  for (;;) {
+    if (ip >= n) {
+      return false;
+    }
+    uint8_t token = in[ip++];
+    size_t nlits = token >> 4;
+    if (nlits == 15 && !get_length(in, n, &ip, &nlits)) {
+      return false;
+    }
+    if (nlits > n - ip || nlits > raw - op) {
+      return false;
+    }
+    memcpy(out + op, in + ip, nlits);
+    ip += nlits;
+    op += nlits;
+    if (ip == n) {
+      break; // the final sequence carries literals only
+    }
+
+    if (n - ip < 2) {
+      return false;
+    }
+    size_t offset = in[ip] | ((size_t)in[ip + 1] << 8);
+    ip += 2;
+    size_t mlen = token & 0x0F;
+    if (mlen == 15 && !get_length(in, n, &ip, &mlen)) {
+      return false;
+    }
+    mlen += LZ_MIN_MATCH;
+    if (offset == 0 || offset > op || mlen > raw - op) {
+      return false;
+    }
+    // byte by byte: the match may overlap the bytes it produces
+    for (size_t i = 0; i < mlen; i++, op++) {
+      out[op] = out[op - offset];
+    }
+  }
+  return op == raw;
+}
+
+void lz_compress_file(FILE *infile, FILE *outfile) {
+
+  uint8_t *raw = (uint8_t *)malloc(LZ_CHUNK);
+  uint8_t *packed = (uint8_t *)malloc(LZ_BOUND(LZ_CHUNK));
+  uint32_t *table = (uint32_t *)malloc(sizeof(uint32_t) << LZ_HASH_BITS);
+  uint8_t header[8];
+  size_t n;
+
+  while ((n = fread(raw, sizeof(uint8_t), LZ_CHUNK, infile)) > 0) {
+    STATS_ADD(RSA_STAT_BYTES_READ, n);
+    size_t stored = compress_chunk(raw, n, packed, table);
+    const uint8_t *body = packed;
+    if (stored >= n) {
+      // did not shrink: store raw, flagged by stored == raw length
+      stored = n;
+      body = raw;
+    }
+    put32(header, (uint32_t)n);
+    put32(header + 4, (uint32_t)stored);
+    fwrite(header, sizeof(uint8_t), sizeof(header), outfile);
+    fwrite(body, sizeof(uint8_t), stored, outfile);
+  }
+
+  free(raw);
+  free(packed);
+  free(table);
+}
+
+bool lz_decompress_file(FILE *infile, FILE *outfile) {
+
+  uint8_t *raw = (uint8_t *)malloc(LZ_CHUNK);
+  uint8_t *packed = (uint8_t *)malloc(LZ_BOUND(LZ_CHUNK));
+  uint8_t header[8];
+  bool ok = true;
+  size_t got;
+
+  while (ok && (got = fread(header, sizeof(uint8_t), sizeof(header),
+                            infile)) > 0) {
+    size_t n = get32(header);
+    size_t stored = get32(header + 4);
+    if (got != sizeof(header) || n == 0 || n > LZ_CHUNK || stored > n ||
+        fread(packed, sizeof(uint8_t), stored, infile) != stored) {
+      ok = false;
+    } else if (stored == n) {
+      fwrite(packed, sizeof(uint8_t), n, outfile);
+      STATS_ADD(RSA_STAT_BYTES_WRITTEN, n);
+    } else if (decompress_chunk(packed, stored, raw, n)) {
+      fwrite(raw, sizeof(uint8_t), n, outfile);
+      STATS_ADD(RSA_STAT_BYTES_WRITTEN, n);
+    } else {
+      ok = false;
+    }
+  }
+
+  free(raw);
+  free(packed);
+  return ok;
+}
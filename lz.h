@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Small LZ77 codec (LZ4-style sequences) used to shrink plaintext before it
+// is encrypted, so redundant input costs fewer RSA blocks.
+// The stream is a series of independent chunks of at most 64 KiB, each
+// framed by its 4-byte big-endian raw and stored lengths. A chunk that does
+// not shrink is stored as is, so incompressible input grows by 8 bytes per
+// 64 KiB at most.
+//
+
+//
+// Compresses all of infile into outfile.
+// The uncompressed bytes read are counted as RSA_STAT_BYTES_READ.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to compress.
+// outfile: the output file to write the compressed stream to.
+//
+void lz_compress_file(FILE *infile, FILE *outfile);
+
+//
+// Decompresses a stream written by lz_compress_file().
+// The uncompressed bytes written are counted as RSA_STAT_BYTES_WRITTEN.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the compressed stream.
+// outfile: the output file to write the original bytes to.
+// returns: false if the stream is truncated or malformed.
+//
+bool lz_decompress_file(FILE *infile, FILE *outfile);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,12 +1,16 @@
 #include "numtheory.h"
 #include "randstate.h"
+#include "stats.h"
 
 void make_prime(mpz_t p, uint64_t bits, uint64_t iters) {
   mpz_urandomb(p, state, bits); // 0 ~ (2^bits - 1)
   // gmp_printf ("%Zd\n", p);
+  uint64_t rejects = 0;
   while (!is_prime(p, iters)) {
     mpz_urandomb(p, state, bits);
+    rejects++;
   }
+  STATS_ADD(RSA_STAT_PRIME_REJECTS, rejects);
 }
 
 bool is_prime(mpz_t p, uint64_t iters) {
@@ -39,6 +43,7 @@ bool is_prime(mpz_t p, uint64_t iters) {
   mpz_inits(a, y, j, NULL);
   // 疊代幾次
   for (uint64_t i = 0; i < iters; i++) {
+    STATS_ADD(RSA_STAT_MR_ROUNDS, 1);
 
     // a: random choose 2 ~ (p-1)
     mpz_urandomm(a, state, pSubThree); // 0 ~ (n-1)
@@ -76,73 +81,156 @@ void pow_mod(mpz_t o, mpz_t a, mpz_t d, mpz_t n) {
   mpz_set(e, d);
   mpz_set_ui(out, 1);
 
+  // counted locally and published once, off the per-bit path
+  uint64_t mulmods = 0, squarings = 0;
   while (mpz_cmp_ui(e, 0) > 0) {
     if (mpz_odd_p(e)) {
       mpz_mul(out, out, base);
       mpz_mod(out, out, n);
+      mulmods++;
     }
     mpz_mul(base, base, base);
     mpz_mod(base, base, n);
+    squarings++;
     mpz_fdiv_q_ui(e, e, 2);
   }
   mpz_set(o, out);
+  STATS_ADD(RSA_STAT_MULMODS, mulmods);
+  STATS_ADD(RSA_STAT_SQUARINGS, squarings);
 
   mpz_clears(base, e, out, NULL);
 }
 
-// Find greatest common divisor
-void gcd(mpz_t d, mpz_t a, mpz_t b) {
-
-  mpz_t tmp, tmp_a, tmp_b, aModb;
-  mpz_inits(tmp, tmp_a, tmp_b, aModb, NULL);
-  mpz_set(tmp_b, b);
-  mpz_set(tmp_a, a);
-
-  // gcd(a, b) => gcd (b, a%b)
-  while (mpz_cmp_ui(tmp_b, 0) != 0) {
-    mpz_set(tmp, tmp_b);
-    mpz_mod(aModb, tmp_a, tmp_b);
-    mpz_set(tmp_b, aModb);
-    mpz_set(tmp_a, tmp);
+// Lehmer works on this many leading bits of the operands at a time. Two bits
+// below 64 keep x + A, y + C and every q * C product inside int64_t.
+#define LEHMER_BITS 62
+
+// Extended gcd with Lehmer's algorithm (Knuth vol. 2, 4.5.2, Algorithm L).
+// Most Euclid quotients are found from the leading LEHMER_BITS of x and y
+// alone; a whole run of them is then applied to the full numbers as one 2x2
+// cofactor matrix, instead of one mpz division and several copies per step.
+// Only the cofactor of a is tracked, the other is recovered at the end.
+void gcd_ext(mpz_t g, mpz_t s, mpz_t t, mpz_t a, mpz_t b) {
+
+  bool cofactors = (s != NULL || t != NULL);
+  mpz_t x, y, sx, sy, q, tmp, tmp2;
+  mpz_inits(x, y, sx, sy, q, tmp, tmp2, NULL);
+
+  // x = sx * a (mod b) and y = sy * a (mod b) throughout, with x >= y
+  mpz_set(x, a);
+  mpz_set(y, b);
+  mpz_set_ui(sx, 1);
+  mpz_set_ui(sy, 0);
+  if (mpz_cmp(x, y) < 0) {
+    mpz_swap(x, y);
+    mpz_swap(sx, sy);
+  }
+
+  while (mpz_sizeinbase(y, 2) > LEHMER_BITS) {
+
+    // the same window of both numbers, aligned to the top of x
+    mp_bitcnt_t shift = mpz_sizeinbase(x, 2) - LEHMER_BITS;
+    mpz_tdiv_q_2exp(tmp, x, shift);
+    int64_t xh = (int64_t)mpz_get_ui(tmp);
+    mpz_tdiv_q_2exp(tmp, y, shift);
+    int64_t yh = (int64_t)mpz_get_ui(tmp);
+
+    // run Euclid on the leading bits while the quotient is provably the one
+    // the full numbers would produce
+    int64_t A = 1, B = 0, C = 0, D = 1;
+    while (yh + C != 0 && yh + D != 0) {
+      int64_t q1 = (xh + A) / (yh + C);
+      if (q1 != (xh + B) / (yh + D)) {
+        break;
+      }
+      int64_t T = A - q1 * C;
+      A = C;
+      C = T;
+      T = B - q1 * D;
+      B = D;
+      D = T;
+      T = xh - q1 * yh;
+      xh = yh;
+      yh = T;
+    }
+
+    if (B == 0) {
+      // no quotient was certain (x much larger than y): one full step
+      mpz_fdiv_qr(q, tmp, x, y);
+      mpz_swap(x, y);
+      mpz_swap(y, tmp);
+      if (cofactors) {
+        mpz_submul(sx, q, sy);
+        mpz_swap(sx, sy);
+      }
+      continue;
+    }
+
+    // (x, y) = (A x + B y, C x + D y), and the same for the cofactors
+    mpz_mul_si(tmp, x, A);
+    mpz_mul_si(tmp2, y, B);
+    mpz_add(tmp, tmp, tmp2);
+    mpz_mul_si(tmp2, x, C);
+    mpz_mul_si(q, y, D);
+    mpz_add(y, tmp2, q);
+    mpz_swap(x, tmp);
+    if (cofactors) {
+      mpz_mul_si(tmp, sx, A);
+      mpz_mul_si(tmp2, sy, B);
+      mpz_add(tmp, tmp, tmp2);
+      mpz_mul_si(tmp2, sx, C);
+      mpz_mul_si(q, sy, D);
+      mpz_add(sy, tmp2, q);
+      mpz_swap(sx, tmp);
+    }
   }
-  mpz_set(d, tmp_a);
-  mpz_clears(tmp, tmp_a, tmp_b, aModb, NULL);
+
+  // y fits in a machine word now, the remaining steps are cheap
+  while (mpz_sgn(y) != 0) {
+    mpz_fdiv_qr(q, tmp, x, y);
+    mpz_swap(x, y);
+    mpz_swap(y, tmp);
+    if (cofactors) {
+      mpz_submul(sx, q, sy);
+      mpz_swap(sx, sy);
+    }
+  }
+
+  // g = sx * a + t * b, so t = (g - sx * a) / b exactly
+  if (t != NULL) {
+    if (mpz_sgn(b) == 0) {
+      mpz_set_ui(t, 0);
+    } else {
+      mpz_mul(tmp, sx, a);
+      mpz_sub(tmp, x, tmp);
+      mpz_divexact(t, tmp, b);
+    }
+  }
+  if (s != NULL) {
+    mpz_set(s, sx);
+  }
+  mpz_set(g, x);
+
+  mpz_clears(x, y, sx, sy, q, tmp, tmp2, NULL);
 }
 
+// Find greatest common divisor
+void gcd(mpz_t d, mpz_t a, mpz_t b) { gcd_ext(d, NULL, NULL, a, b); }
+
 // Computes the inverse i of a modulo n. In the event that a modular inverse
 // cannot be found, set i to 0
 void mod_inverse(mpz_t o, mpz_t a, mpz_t n) {
 
-  mpz_t r, rsub, t, tsub, q, tmp_r, tmp_t;
-  mpz_inits(r, rsub, t, tsub, q, tmp_r, tmp_t, NULL);
-
-  mpz_set(r, n);
-  mpz_set(rsub, a);
-  mpz_set_ui(t, 0);
-  mpz_set_ui(tsub, 1);
-
-  while (mpz_cmp_ui(rsub, 0) != 0) {
-    mpz_fdiv_q(q, r, rsub);
-    mpz_set(tmp_r, r);
-    mpz_set(r, rsub);
-    mpz_mul(rsub, q, rsub);
-    mpz_sub(rsub, tmp_r, rsub);
-    mpz_set(tmp_t, t);
-    mpz_set(t, tsub);
-    mpz_mul(tsub, q, tsub);
-    mpz_sub(tsub, tmp_t, tsub);
-  }
+  mpz_t g, s;
+  mpz_inits(g, s, NULL);
 
-  if (mpz_cmp_ui(r, 1) > 0) {
+  // s * a + t * n = gcd(a, n), so s is the inverse when the gcd is 1
+  gcd_ext(g, s, NULL, a, n);
+  if (mpz_cmp_ui(g, 1) != 0) {
     mpz_set_ui(o, 0);
-    mpz_clears(r, rsub, t, tsub, q, tmp_r, tmp_t, NULL);
-    return;
-  }
-
-  if (mpz_cmp_ui(t, 0) < 0) {
-    mpz_add(t, t, n);
+  } else {
+    mpz_mod(o, s, n);
   }
 
-  mpz_set(o, t);
-  mpz_clears(r, rsub, t, tsub, q, tmp_r, tmp_t, NULL);
+  mpz_clears(g, s, NULL);
 }
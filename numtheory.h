@@ -5,8 +5,19 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void gcd(mpz_t d, mpz_t a, mpz_t b);
 
+//
+// Extended greatest common divisor of non-negative a and b (Lehmer's
+// algorithm): g = gcd(a, b) = s * a + t * b.
+// s and t may be NULL when that cofactor is not needed.
+//
+void gcd_ext(mpz_t g, mpz_t s, mpz_t t, mpz_t a, mpz_t b);
+
 void mod_inverse(mpz_t o, mpz_t a, mpz_t n);
 
 void pow_mod(mpz_t o, mpz_t a, mpz_t d, mpz_t n);
@@ -14,3 +25,7 @@ void pow_mod(mpz_t o, mpz_t a, mpz_t d, mpz_t n);
 bool is_prime(mpz_t p, uint64_t iters);
 
 void make_prime(mpz_t p, uint64_t bits, uint64_t iters);
+
+#ifdef __cplusplus
+}
+#endif
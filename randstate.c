@@ -1,3 +1,5 @@
+#include <stdio.h>
+
 #include "randstate.h"
 
 gmp_randstate_t state;
@@ -8,3 +10,13 @@ void randstate_init(uint64_t seed) {
 }
 
 void randstate_clear() { gmp_randclear(state); }
+
+bool randstate_entropy(uint8_t *buf, size_t len) {
+  FILE *urandom = fopen("/dev/urandom", "rb");
+  if (urandom == NULL) {
+    return false;
+  }
+  size_t got = fread(buf, sizeof(uint8_t), len, urandom);
+  fclose(urandom);
+  return got == len;
+}
@@ -1,8 +1,14 @@
 #pragma once
 
 #include <gmp.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern gmp_randstate_t state;
 
 //
@@ -19,3 +25,18 @@ void randstate_init(uint64_t seed);
 // Must be called after all key generation or number theory operations are used.
 //
 void randstate_clear(void);
+
+//
+// Fills a buffer from the operating system's entropy source (/dev/urandom).
+// Unlike the seeded random state, the output is not reproducible, so it is
+// suitable for one-time session keys.
+//
+// buf: the buffer to fill.
+// len: the number of bytes to fill.
+// returns: true on success, false if the entropy source could not be read.
+//
+bool randstate_entropy(uint8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,8 +1,20 @@
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "chacha20.h"
+#include "checkpoint.h"
 #include "numtheory.h"
 #include "randstate.h"
 #include "rsa.h"
+#include "stats.h"
+
+// bytes moved per read while streaming the bulk of a multi-recipient file
+#define STREAM_CHUNK 65536
+
+// 0xFF guard byte + session key, laid out like a rsa_encrypt_file block
+#define SESSION_BLOCK_BYTES (1 + CHACHA20_KEY_BYTES)
 
 void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits,
                   uint64_t iters) {
@@ -67,8 +79,9 @@ void rsa_write_priv(mpz_t n, mpz_t d, FILE *pvfile) {
   gmp_fprintf(pvfile, "%Zx\n%Zx\n", n, d);
 }
 
-void rsa_read_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile) {
-  gmp_fscanf(pbfile, "%Zx\n%Zx\n%Zx\n%s\n", n, e, s, username);
+bool rsa_read_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile) {
+  return gmp_fscanf(pbfile, "%Zx\n%Zx\n%Zx\n%s\n", n, e, s, username) == 4 &&
+         mpz_cmp_ui(n, 1) > 0;
 }
 
 bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n) {
@@ -87,56 +100,437 @@ bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n) {
 }
 
 void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
+  rsa_encrypt_file_ckpt(infile, outfile, n, e, NULL, false, false);
+}
+
+void rsa_encrypt(mpz_t c, mpz_t m, mpz_t e, mpz_t n) { pow_mod(c, m, e, n); }
+
+bool rsa_read_priv(mpz_t n, mpz_t d, FILE *pvfile) {
+  return gmp_fscanf(pvfile, "%Zx\n%Zx\n", n, d) == 2 && mpz_cmp_ui(n, 1) > 0;
+}
+
+void rsa_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t n) { pow_mod(m, c, d, n); }
+
+bool rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d) {
+  return rsa_decrypt_file_ckpt(infile, outfile, n, d, NULL, false, false);
+}
+
+// XOR the rest of infile with the session keystream into outfile
+static void stream_session(FILE *infile, FILE *outfile, uint8_t *key) {
+  chacha20_t cipher;
+  chacha20_init(&cipher, key);
+
+  uint8_t *chunk = (uint8_t *)malloc(STREAM_CHUNK);
+  size_t j;
+  STATS_TIMER(lap);
+  while ((j = fread(chunk, sizeof(uint8_t), STREAM_CHUNK, infile)) > 0) {
+    STATS_LAP(RSA_STAT_IO_NS, lap);
+    chacha20_xor(&cipher, chunk, j);
+    STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
+    fwrite(chunk, sizeof(uint8_t), j, outfile);
+    STATS_LAP(RSA_STAT_IO_NS, lap);
+    STATS_ADD(RSA_STAT_BYTES_READ, j);
+    STATS_ADD(RSA_STAT_BYTES_WRITTEN, j);
+  }
+
+  memset(&cipher, 0, sizeof(cipher));
+  free(chunk);
+}
+
+bool rsa_encrypt_file_multi(FILE *infile, FILE *outfile, mpz_t n[], mpz_t e[],
+                            size_t count) {
+
+  // every recipient block must be able to carry the whole session key
+  for (size_t i = 0; i < count; i++) {
+    if ((mpz_sizeinbase(n[i], 2) - 1) / 8 < SESSION_BLOCK_BYTES) {
+      return false;
+    }
+  }
+
+  uint8_t session[SESSION_BLOCK_BYTES];
+  session[0] = 0xFF;
+  if (!randstate_entropy(session + 1, CHACHA20_KEY_BYTES)) {
+    return false;
+  }
 
   mpz_t m, c;
+  mpz_inits(m, c, NULL);
+  mpz_import(m, SESSION_BLOCK_BYTES, 1, sizeof(uint8_t), 1, 0, session);
+
+  // one small modexp per recipient, the bulk is encrypted only once
+  STATS_TIMER(lap);
+  int written = fprintf(outfile, "%s %zu\n", RSA_MULTI_MAGIC, count);
+  for (size_t i = 0; i < count; i++) {
+    rsa_encrypt(c, m, e[i], n[i]);
+    written += gmp_fprintf(outfile, "%Zx %Zx\n", n[i], c);
+  }
+  STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
+  STATS_ADD(RSA_STAT_BLOCKS, count);
+  STATS_ADD(RSA_STAT_BYTES_WRITTEN, written);
+  stream_session(infile, outfile, session + 1);
+
+  memset(session, 0, sizeof(session));
+  mpz_clears(m, c, NULL);
+  return true;
+}
+
+bool rsa_decrypt_file_multi(FILE *infile, FILE *outfile, mpz_t n, mpz_t d) {
+
+  char *line = NULL;
+  size_t cap = 0;
+  size_t count = 0;
+  bool found = false;
+
+  // header lines are read whole so no byte of the binary body is consumed
+  if (getline(&line, &cap, infile) < 0 ||
+      sscanf(line, RSA_MULTI_MAGIC " %zu", &count) != 1) {
+    free(line);
+    return false;
+  }
+  STATS_ADD(RSA_STAT_BYTES_READ, strlen(line));
+
+  mpz_t rn, c, m;
+  mpz_inits(rn, c, m, NULL);
+  for (size_t i = 0; i < count; i++) {
+    char *wrapped;
+    if (getline(&line, &cap, infile) < 0 ||
+        (wrapped = strchr(line, ' ')) == NULL) {
+      break;
+    }
+    STATS_ADD(RSA_STAT_BYTES_READ, strlen(line));
+    *wrapped++ = '\0';
+    mpz_set_str(rn, line, 16);
+    if (!found && mpz_cmp(rn, n) == 0) {
+      found = (mpz_set_str(c, wrapped, 16) == 0);
+    }
+  }
+  free(line);
+
+  uint8_t session[SESSION_BLOCK_BYTES];
+  if (found) {
+    STATS_TIMER(lap);
+    rsa_decrypt(m, c, d, n);
+    STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
+    STATS_ADD(RSA_STAT_BLOCKS, 1);
+    // a mismatched private key decrypts to an n-sized number, not our block
+    found = (mpz_sizeinbase(m, 2) == 8 * SESSION_BLOCK_BYTES);
+  }
+  if (found) {
+    mpz_export(session, NULL, 1, sizeof(uint8_t), 1, 0, m);
+    found = (session[0] == 0xFF);
+  }
+  if (found) {
+    stream_session(infile, outfile, session + 1);
+  }
+
+  memset(session, 0, sizeof(session));
+  mpz_clears(rn, c, m, NULL);
+  return found;
+}
+
+// read one record: up to and including a newline, at most max bytes
+static size_t read_record(FILE *infile, uint8_t *record, size_t max) {
+  size_t len = 0;
+  int ch;
+  while (len < max && (ch = getc(infile)) != EOF) {
+    record[len++] = (uint8_t)ch;
+    if (ch == '\n') {
+      break;
+    }
+  }
+  return len;
+}
+
+void rsa_encrypt_records(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
+
+  mpz_t m, c;
+  mpz_inits(m, c, NULL);
+  size_t k = ((mpz_sizeinbase(n, 2) - 1) / 8);
+
+  uint8_t *record = (uint8_t *)malloc(RSA_RECORD_MAX);
+  uint8_t *block = (uint8_t *)calloc(k, sizeof(uint8_t));
+  block[0] = 0xFF;
+
+  size_t len;
+  STATS_TIMER(lap);
+  while ((len = read_record(infile, record, RSA_RECORD_MAX)) > 0) {
+    STATS_LAP(RSA_STAT_IO_NS, lap);
+    STATS_ADD(RSA_STAT_BYTES_READ, len);
+
+    // length first, so the reader knows where this record ends
+    int written = fprintf(outfile, "%zx\n", len);
+    for (size_t off = 0; off < len; off += k - 1) {
+      size_t j = (len - off < k - 1) ? len - off : k - 1;
+      memcpy(block + 1, record + off, j);
+      mpz_import(m, j + 1, 1, sizeof(uint8_t), 1, 0, block);
+      rsa_encrypt(c, m, e, n);
+      written += gmp_fprintf(outfile, "%Zx\n", c);
+      STATS_ADD(RSA_STAT_BLOCKS, 1);
+    }
+    STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
+    fflush(outfile);
+    STATS_LAP(RSA_STAT_IO_NS, lap);
+    STATS_ADD(RSA_STAT_BYTES_WRITTEN, written);
+  }
+
+  mpz_clears(m, c, NULL);
+  free(record);
+  free(block);
+}
+
+bool rsa_decrypt_records(FILE *infile, FILE *outfile, mpz_t n, mpz_t d) {
+
+  mpz_t c, m;
   mpz_inits(c, m, NULL);
+  size_t k = (mpz_sizeinbase(n, 2) - 1) / 8;
+
+  // one ciphertext line: the hex digits of n, a newline and a NUL
+  size_t linecap = mpz_sizeinbase(n, 16) + 2;
+  char *line = (char *)malloc(linecap);
+  uint8_t *record = (uint8_t *)malloc(RSA_RECORD_MAX);
+  uint8_t *block = (uint8_t *)calloc(k, sizeof(uint8_t));
+  bool ok = true;
+
+  // fgets returns at each newline, so a record is written as soon as its
+  // last block has arrived instead of waiting for more input
+  STATS_TIMER(lap);
+  while (ok && fgets(line, linecap, infile) != NULL) {
+    char *end;
+    size_t len = strtoul(line, &end, 16);
+    if (end == line || *end != '\n' || len == 0 || len > RSA_RECORD_MAX) {
+      ok = false;
+      break;
+    }
+    STATS_ADD(RSA_STAT_BYTES_READ, strlen(line));
+
+    for (size_t off = 0; off < len; off += k - 1) {
+      size_t want = (len - off < k - 1) ? len - off : k - 1;
+      size_t j;
+      if (fgets(line, linecap, infile) == NULL ||
+          mpz_set_str(c, line, 16) != 0) {
+        ok = false;
+        break;
+      }
+      STATS_LAP(RSA_STAT_IO_NS, lap);
+      STATS_ADD(RSA_STAT_BYTES_READ, strlen(line));
+      rsa_decrypt(m, c, d, n);
+      // anything but 0xFF + want bytes means a corrupt or foreign block
+      if (mpz_sizeinbase(m, 2) != 8 * (want + 1)) {
+        ok = false;
+        break;
+      }
+      mpz_export(block, &j, 1, sizeof(uint8_t), 1, 0, m);
+      if (block[0] != 0xFF) {
+        ok = false;
+        break;
+      }
+      memcpy(record + off, block + 1, want);
+      STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
+      STATS_ADD(RSA_STAT_BLOCKS, 1);
+    }
+    if (!ok) {
+      break;
+    }
+
+    fwrite(record, sizeof(uint8_t), len, outfile);
+    fflush(outfile);
+    STATS_LAP(RSA_STAT_IO_NS, lap);
+    STATS_ADD(RSA_STAT_BYTES_WRITTEN, len);
+  }
+
+  mpz_clears(c, m, NULL);
+  free(line);
+  free(record);
+  free(block);
+  return ok;
+}
+
+// seek both files back to the recorded boundary and drop any output after it
+static bool resume_at(const char *ckpath, checkpoint_t *ck, FILE *infile,
+                      FILE *outfile) {
+  checkpoint_t saved;
+  struct stat st;
+  if (ckpath == NULL || !checkpoint_load(ckpath, &saved) ||
+      saved.block != ck->block) {
+    return false;
+  }
+  // the output is synced before every checkpoint, so it is never shorter
+  if (fflush(outfile) != 0 || fstat(fileno(outfile), &st) != 0 ||
+      (uint64_t)st.st_size < saved.out_off ||
+      ftruncate(fileno(outfile), saved.out_off) != 0 ||
+      fseeko(outfile, saved.out_off, SEEK_SET) != 0 ||
+      fseeko(infile, saved.in_off, SEEK_SET) != 0) {
+    return false;
+  }
+  *ck = saved;
+  return true;
+}
+
+// make the output durable up to here, then record the boundary
+static bool checkpoint_at(const char *ckpath, const checkpoint_t *ck,
+                          FILE *outfile) {
+  return fflush(outfile) == 0 && fsync(fileno(outfile)) == 0 &&
+         checkpoint_save(ckpath, ck);
+}
+
+// the job is complete: sync the output, then the sidecar is no longer needed
+static bool checkpoint_done(const char *ckpath, FILE *outfile) {
+  if (fflush(outfile) != 0 || fsync(fileno(outfile)) != 0) {
+    return false;
+  }
+  unlink(ckpath);
+  return true;
+}
+
+bool rsa_encrypt_file_ckpt(FILE *infile, FILE *outfile, mpz_t n, mpz_t e,
+                           const char *ckpath, bool resume, bool progress) {
+
   size_t k = ((mpz_sizeinbase(n, 2) - 1) / 8);
+  checkpoint_t ck = {0, 0, 0, k};
+  if (resume && !resume_at(ckpath, &ck, infile, outfile)) {
+    return false;
+  }
+  // a run killed before its first interval can still resume, from the start
+  if (ckpath != NULL && !resume && !checkpoint_at(ckpath, &ck, outfile)) {
+    return false;
+  }
 
-  // allocate memory for block
+  mpz_t m, c;
+  mpz_inits(c, m, NULL);
   uint8_t *block = (uint8_t *)calloc(k, sizeof(uint8_t));
   block[0] = 0xFF;
   size_t j = 1;
+  bool ok = true;
+
+  progress_t report;
+  if (progress) {
+    progress_start(&report, infile, ck.in_off);
+  }
+  uint64_t saved_ns = rsa_stats_now_ns();
 
+  STATS_TIMER(lap);
   while (j > 0) {
     j = fread(block + 1, sizeof(uint8_t), k - 1, infile);
+    STATS_LAP(RSA_STAT_IO_NS, lap);
     // mpz_import(output, number of element, order = 1, size (uint8_t),
     // endian = 1, nails = 0, block)
     mpz_import(m, j + 1, 1, sizeof(uint8_t), 1, 0, block);
     rsa_encrypt(c, m, e, n);
-    gmp_fprintf(outfile, "%Zx\n", c);
+    STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
+    int written = gmp_fprintf(outfile, "%Zx\n", c);
+    STATS_LAP(RSA_STAT_IO_NS, lap);
+    STATS_ADD(RSA_STAT_BLOCKS, 1);
+    STATS_ADD(RSA_STAT_BYTES_READ, j);
+    STATS_ADD(RSA_STAT_BYTES_WRITTEN, written);
+
+    ck.in_off += j;
+    ck.out_off += written;
+    ck.blocks++;
+    if (progress) {
+      progress_update(&report, ck.in_off, false);
+    }
+    if (ckpath != NULL &&
+        rsa_stats_now_ns() - saved_ns >= CHECKPOINT_INTERVAL_NS) {
+      if (!checkpoint_at(ckpath, &ck, outfile)) {
+        ok = false;
+        break;
+      }
+      saved_ns = rsa_stats_now_ns();
+    }
+  }
+
+  if (progress) {
+    progress_update(&report, ck.in_off, true);
+  }
+  if (ok && ckpath != NULL) {
+    ok = checkpoint_done(ckpath, outfile);
   }
 
-  // free memory
   mpz_clears(c, m, NULL);
   free(block);
+  return ok;
 }
 
-void rsa_encrypt(mpz_t c, mpz_t m, mpz_t e, mpz_t n) { pow_mod(c, m, e, n); }
-
-void rsa_read_priv(mpz_t n, mpz_t d, FILE *pvfile) {
-  gmp_fscanf(pvfile, "%Zx\n%Zx\n", n, d);
-}
+bool rsa_decrypt_file_ckpt(FILE *infile, FILE *outfile, mpz_t n, mpz_t d,
+                           const char *ckpath, bool resume, bool progress) {
 
-void rsa_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t n) { pow_mod(m, c, d, n); }
-
-void rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d) {
+  size_t k = (mpz_sizeinbase(n, 2) - 1) / 8;
+  checkpoint_t ck = {0, 0, 0, k};
+  if (resume && !resume_at(ckpath, &ck, infile, outfile)) {
+    return false;
+  }
+  // a run killed before its first interval can still resume, from the start
+  if (ckpath != NULL && !resume && !checkpoint_at(ckpath, &ck, outfile)) {
+    return false;
+  }
 
   mpz_t c, m;
   mpz_inits(c, m, NULL);
-  size_t k = (mpz_sizeinbase(n, 2) - 1) / 8;
-  size_t j = 1;
-
-  // allocate memory for block
   uint8_t *block = (uint8_t *)calloc(k, sizeof(uint8_t));
+  size_t j;
+  bool ok = true;
 
-  while (!feof(infile)) {
-    j = gmp_fscanf(infile, "%Zx\n", c);
+  progress_t report;
+  if (progress) {
+    progress_start(&report, infile, ck.in_off);
+  }
+  uint64_t saved_ns = rsa_stats_now_ns();
+
+  STATS_TIMER(lap);
+  while (gmp_fscanf(infile, "%Zx\n", c) == 1) {
+    STATS_LAP(RSA_STAT_IO_NS, lap);
     rsa_decrypt(m, c, d, n);
+    // a valid block is 0xFF plus at most k - 1 bytes
+    if (mpz_sizeinbase(m, 2) > 8 * k) {
+      ok = false;
+      break;
+    }
     mpz_export(block, &j, 1, sizeof(uint8_t), 1, 0, m);
+    if (j == 0 || block[0] != 0xFF) {
+      ok = false;
+      break;
+    }
+    STATS_LAP(RSA_STAT_COMPUTE_NS, lap);
     fwrite((block + 1), sizeof(uint8_t), j - 1, outfile);
+    STATS_LAP(RSA_STAT_IO_NS, lap);
+    STATS_ADD(RSA_STAT_BLOCKS, 1);
+    STATS_ADD(RSA_STAT_BYTES_READ, mpz_sizeinbase(c, 16) + 1);
+    STATS_ADD(RSA_STAT_BYTES_WRITTEN, j - 1);
+
+    // checkpoints need the exact offset; pipes only get the hex line length
+    if (ckpath != NULL) {
+      ck.in_off = ftello(infile);
+    } else {
+      ck.in_off += mpz_sizeinbase(c, 16) + 1;
+    }
+    ck.out_off += j - 1;
+    ck.blocks++;
+    if (progress) {
+      progress_update(&report, ck.in_off, false);
+    }
+    if (ckpath != NULL &&
+        rsa_stats_now_ns() - saved_ns >= CHECKPOINT_INTERVAL_NS) {
+      if (!checkpoint_at(ckpath, &ck, outfile)) {
+        ok = false;
+        break;
+      }
+      saved_ns = rsa_stats_now_ns();
+    }
+  }
+  // stopping on anything but end of file means the input is not ciphertext;
+  // rsa_encrypt_file always writes at least one block
+  if (ok && (!feof(infile) || ck.blocks == 0)) {
+    ok = false;
+  }
+
+  if (progress) {
+    progress_update(&report, ck.in_off, true);
+  }
+  if (ok && ckpath != NULL) {
+    ok = checkpoint_done(ckpath, outfile);
   }
 
-  // free memory
   mpz_clears(c, m, NULL);
   free(block);
+  return ok;
 }
@@ -3,10 +3,26 @@
 #include <gmp.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include <stdlib.h>
 #include <time.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// First token of a file produced by rsa_encrypt_file_multi. Single-recipient
+// output only ever starts with a hex digit, so one character tells them apart.
+#define RSA_MULTI_MAGIC "RSAM"
+
+// Marker line of a compressed file: the rest is an ordinary encrypted file
+// (single or multi-recipient) whose plaintext is lz_compress_file() output.
+#define RSA_LZ_MAGIC "LZ"
+
+// Longest record handled by the record functions; longer lines are split.
+#define RSA_RECORD_MAX 65536
+
 //
 // Generates the components for a new public RSA key.
 // p and q will be large primes with n their product.
@@ -45,8 +61,10 @@ void rsa_write_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile);
 // s: will store the signature.
 // username: an allocated array to hold the username.
 // pbfile: the file containing the public key
+// returns: false if the file is short or malformed or the modulus is not
+//          greater than 1.
 //
-void rsa_read_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile);
+bool rsa_read_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile);
 
 //
 // Generates the components for a new private RSA key.
@@ -78,7 +96,11 @@ void rsa_write_priv(mpz_t n, mpz_t d, FILE *pvfile);
 //
 // n: will store the public modulus.
 // d: will store the private key.
-void rsa_read_priv(mpz_t n, mpz_t d, FILE *pvfile);
+// pvfile: the file containing the private key.
+// returns: false if the file is short or malformed or the modulus is not
+//          greater than 1.
+//
+bool rsa_read_priv(mpz_t n, mpz_t d, FILE *pvfile);
 
 //
 // Encrypts a message given an RSA public exponent and modulus.
@@ -103,6 +125,65 @@ void rsa_encrypt(mpz_t c, mpz_t m, mpz_t e, mpz_t n);
 //
 void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e);
 
+//
+// Encrypts an entire file once for several recipients.
+// The input is read and encrypted a single time with a random ChaCha20 session
+// key; only that key is encrypted with rsa_encrypt() for each recipient.
+// Output: a "RSAM <count>" line, one "<n> <wrapped key>" hex line per
+// recipient, then the raw encrypted bytes.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to encrypt.
+// outfile: the output file to write the encrypted input to.
+// n: the public moduli, one per recipient.
+// e: the public exponents, one per recipient.
+// count: the number of recipients.
+// returns: false if a modulus is too small to hold the session key or no
+//          session key could be generated. Nothing is written in that case.
+//
+bool rsa_encrypt_file_multi(FILE *infile, FILE *outfile, mpz_t n[], mpz_t e[],
+                            size_t count);
+
+//
+// Encrypts a stream one record at a time, for pipes and sockets.
+// A record is one input line including its newline (or RSA_RECORD_MAX bytes
+// of a longer line). Each record is written as a hex length line followed by
+// its own blocks, and the output is flushed before the next record is read,
+// so memory stays bounded and nothing waits for stdio buffers to fill.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input stream to encrypt.
+// outfile: the output stream to write the records to.
+// n: the public modulus.
+// e: the public exponent.
+//
+void rsa_encrypt_records(FILE *infile, FILE *outfile, mpz_t n, mpz_t e);
+
+//
+// rsa_encrypt_file() for very large inputs: same output, plus progress
+// reporting and periodic checkpoints that let a killed job continue.
+// A first checkpoint at offset 0 is written before any block, then every
+// CHECKPOINT_INTERVAL_NS the output is synced and the input offset, output
+// offset and block count are written to the sidecar file ckpath.
+// The sidecar is removed once the whole file is done.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to encrypt; must be seekable to resume.
+// outfile: the output file; must be opened for update ("r+") to resume.
+// n: the public modulus.
+// e: the public exponent.
+// ckpath: the checkpoint sidecar, or NULL to not checkpoint.
+// resume: continue after the checkpoint in ckpath instead of from the start.
+// progress: report progress and throughput on stderr.
+// returns: false if resuming failed (missing sidecar, different key, files
+//          not seekable) or a checkpoint could not be written.
+//
+bool rsa_encrypt_file_ckpt(FILE *infile, FILE *outfile, mpz_t n, mpz_t e,
+                           const char *ckpath, bool resume, bool progress);
+
 //
 // Decrypts some ciphertext given an RSA private key and public modulus.
 // All mpz_t arguments are expected to be initialized.
@@ -123,8 +204,58 @@ void rsa_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t n);
 // outfile: the output file to write the decrypted input to.
 // n: the public modulus.
 // d: the private key.
+// returns: false if the input is empty or not a run of valid blocks.
 //
-void rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d);
+bool rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d);
+
+//
+// rsa_decrypt_file() with progress reporting and resumable checkpoints.
+// Works like rsa_encrypt_file_ckpt(), on files written by rsa_encrypt_file().
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to decrypt; must be seekable to checkpoint.
+// outfile: the output file; must be opened for update ("r+") to resume.
+// n: the public modulus.
+// d: the private key.
+// ckpath: the checkpoint sidecar, or NULL to not checkpoint.
+// resume: continue after the checkpoint in ckpath instead of from the start.
+// progress: report progress and throughput on stderr.
+// returns: false if resuming failed, a checkpoint could not be written, the
+//          input is empty or a block does not decrypt to a valid plaintext
+//          block.
+//
+bool rsa_decrypt_file_ckpt(FILE *infile, FILE *outfile, mpz_t n, mpz_t d,
+                           const char *ckpath, bool resume, bool progress);
+
+//
+// Decrypts a stream written by rsa_encrypt_records().
+// Every record is written out whole and flushed as soon as its last block
+// arrives, preserving the original record boundaries.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input stream to decrypt.
+// outfile: the output stream to write the records to.
+// n: the public modulus.
+// d: the private key.
+// returns: false if the stream ends inside a record or a frame is malformed.
+//
+bool rsa_decrypt_records(FILE *infile, FILE *outfile, mpz_t n, mpz_t d);
+
+//
+// Decrypts a file written by rsa_encrypt_file_multi().
+// The recipient entry is found by matching its modulus against n.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to decrypt.
+// outfile: the output file to write the decrypted input to.
+// n: the public modulus.
+// d: the private key.
+// returns: false if the header is malformed or holds no entry for n.
+//
+bool rsa_decrypt_file_multi(FILE *infile, FILE *outfile, mpz_t n, mpz_t d);
 
 //
 // Signs some message given an RSA private key and public modulus.
@@ -149,3 +280,7 @@ void rsa_sign(mpz_t s, mpz_t m, mpz_t d, mpz_t n);
 // returns: true if signature is verified, false otherwise.
 //
 bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n);
+
+#ifdef __cplusplus
+}
+#endif
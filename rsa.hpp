@@ -0,0 +1,256 @@
+#pragma once
+
+//
+// Header-only C++ interface over librsa.
+// Everything here forwards to the C functions in rsa.h; the classes only add
+// ownership of the mpz_t values and key files so they are released on scope
+// exit. Big integers are move-only: moving a key swaps limb pointers and never
+// copies the underlying numbers.
+//
+// Requires C++20 (std::span).
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "randstate.h"
+#include "rsa.h"
+
+namespace rsa {
+
+//
+// Owns one mpz_t.
+// A moved-from Integer holds a valid (unspecified) value and may be reused or
+// destroyed. Use clone() where a real copy of the number is wanted.
+//
+class Integer {
+public:
+  Integer() { mpz_init(v_); }
+
+  explicit Integer(unsigned long x) { mpz_init_set_ui(v_, x); }
+
+  Integer(const std::string &str, int base) {
+    if (mpz_init_set_str(v_, str.c_str(), base) != 0) {
+      mpz_clear(v_);
+      throw std::invalid_argument("rsa::Integer: invalid number string");
+    }
+  }
+
+  ~Integer() { mpz_clear(v_); }
+
+  Integer(Integer &&other) noexcept {
+    mpz_init(v_);
+    mpz_swap(v_, other.v_);
+  }
+
+  Integer &operator=(Integer &&other) noexcept {
+    mpz_swap(v_, other.v_);
+    return *this;
+  }
+
+  Integer(const Integer &) = delete;
+  Integer &operator=(const Integer &) = delete;
+
+  Integer clone() const {
+    Integer r;
+    mpz_set(r.v_, v_);
+    return r;
+  }
+
+  // The C API takes every mpz_t by non-const pointer, including pure inputs.
+  mpz_ptr get() const { return const_cast<mpz_ptr>(v_); }
+
+  size_t bits() const { return mpz_sizeinbase(v_, 2); }
+
+  bool operator==(const Integer &other) const {
+    return mpz_cmp(v_, other.v_) == 0;
+  }
+
+private:
+  mpz_t v_;
+};
+
+namespace detail {
+
+struct FileCloser {
+  void operator()(FILE *f) const { fclose(f); }
+};
+
+using File = std::unique_ptr<FILE, FileCloser>;
+
+inline File open(const std::string &path, const char *mode) {
+  File f(fopen(path.c_str(), mode));
+  if (!f) {
+    throw std::runtime_error("rsa: cannot open " + path);
+  }
+  return f;
+}
+
+template <typename In, typename Out>
+void check_batch(std::span<In> in, std::span<Out> out) {
+  if (in.size() != out.size()) {
+    throw std::invalid_argument("rsa: batch input and output sizes differ");
+  }
+}
+
+} // namespace detail
+
+//
+// Scoped owner of the global random state used by key generation.
+// Only one may be alive at a time, matching randstate_init/randstate_clear.
+//
+class RandomState {
+public:
+  explicit RandomState(uint64_t seed) { randstate_init(seed); }
+  ~RandomState() { randstate_clear(); }
+
+  RandomState(const RandomState &) = delete;
+  RandomState &operator=(const RandomState &) = delete;
+};
+
+class PublicKey {
+public:
+  PublicKey(Integer n, Integer e, Integer s, std::string username)
+      : n_(std::move(n)), e_(std::move(e)), s_(std::move(s)),
+        username_(std::move(username)) {}
+
+  static PublicKey load(const std::string &path) {
+    detail::File f = detail::open(path, "r");
+    Integer n, e, s;
+    char username[65536] = {0};
+    if (!rsa_read_pub(n.get(), e.get(), s.get(), username, f.get())) {
+      throw std::runtime_error("rsa: malformed public key " + path);
+    }
+    return PublicKey(std::move(n), std::move(e), std::move(s), username);
+  }
+
+  void save(const std::string &path) const {
+    detail::File f = detail::open(path, "w");
+    rsa_write_pub(n_.get(), e_.get(), s_.get(),
+                  const_cast<char *>(username_.c_str()), f.get());
+  }
+
+  //
+  // Checks the stored signature against the stored username, exactly as the
+  // encrypt program does before using a key.
+  //
+  bool verify() const {
+    Integer m(username_, 62);
+    return rsa_verify(m.get(), s_.get(), e_.get(), n_.get());
+  }
+
+  Integer encrypt(const Integer &m) const {
+    Integer c;
+    rsa_encrypt(c.get(), m.get(), e_.get(), n_.get());
+    return c;
+  }
+
+  //
+  // Encrypts m[i] into c[i] for every i. Both spans must be the same length.
+  // Results are written into the existing Integers, reusing their limbs.
+  //
+  void encrypt_batch(std::span<const Integer> m, std::span<Integer> c) const {
+    detail::check_batch(m, c);
+    for (size_t i = 0; i < m.size(); i++) {
+      rsa_encrypt(c[i].get(), m[i].get(), e_.get(), n_.get());
+    }
+  }
+
+  void encrypt_file(FILE *infile, FILE *outfile) const {
+    rsa_encrypt_file(infile, outfile, n_.get(), e_.get());
+  }
+
+  const Integer &n() const { return n_; }
+  const Integer &e() const { return e_; }
+  const Integer &signature() const { return s_; }
+  const std::string &username() const { return username_; }
+
+private:
+  Integer n_, e_, s_;
+  std::string username_;
+};
+
+class PrivateKey {
+public:
+  PrivateKey(Integer n, Integer d) : n_(std::move(n)), d_(std::move(d)) {}
+
+  static PrivateKey load(const std::string &path) {
+    detail::File f = detail::open(path, "r");
+    Integer n, d;
+    if (!rsa_read_priv(n.get(), d.get(), f.get())) {
+      throw std::runtime_error("rsa: malformed private key " + path);
+    }
+    return PrivateKey(std::move(n), std::move(d));
+  }
+
+  void save(const std::string &path) const {
+    detail::File f = detail::open(path, "w");
+    rsa_write_priv(n_.get(), d_.get(), f.get());
+  }
+
+  Integer decrypt(const Integer &c) const {
+    Integer m;
+    rsa_decrypt(m.get(), c.get(), d_.get(), n_.get());
+    return m;
+  }
+
+  //
+  // Decrypts c[i] into m[i] for every i. Both spans must be the same length.
+  //
+  void decrypt_batch(std::span<const Integer> c, std::span<Integer> m) const {
+    detail::check_batch(c, m);
+    for (size_t i = 0; i < c.size(); i++) {
+      rsa_decrypt(m[i].get(), c[i].get(), d_.get(), n_.get());
+    }
+  }
+
+  void decrypt_file(FILE *infile, FILE *outfile) const {
+    if (!rsa_decrypt_file(infile, outfile, n_.get(), d_.get())) {
+      throw std::runtime_error("rsa: corrupt ciphertext");
+    }
+  }
+
+  Integer sign(const Integer &m) const {
+    Integer s;
+    rsa_sign(s.get(), m.get(), d_.get(), n_.get());
+    return s;
+  }
+
+  const Integer &n() const { return n_; }
+  const Integer &d() const { return d_; }
+
+private:
+  Integer n_, d_;
+};
+
+struct KeyPair {
+  PublicKey pub;
+  PrivateKey priv;
+
+  //
+  // Generates a new key pair and signs username with it, as keygen does.
+  // The RandomState argument only proves the random state is initialized.
+  //
+  static KeyPair generate(const RandomState &, uint64_t nbits, uint64_t iters,
+                          const std::string &username) {
+    Integer p, q, n, e, d;
+    rsa_make_pub(p.get(), q.get(), n.get(), e.get(), nbits, iters);
+    rsa_make_priv(d.get(), e.get(), p.get(), q.get());
+
+    Integer m(username, 62);
+    Integer s;
+    rsa_sign(s.get(), m.get(), d.get(), n.get());
+
+    Integer pub_n = n.clone();
+    return KeyPair{PublicKey(std::move(pub_n), std::move(e), std::move(s),
+                             username),
+                   PrivateKey(std::move(n), std::move(d))};
+  }
+};
+
+} // namespace rsa
@@ -0,0 +1,73 @@
+//
+// Example use of the C++ interface in rsa.hpp, built by make and run by
+// make check: generates a key pair, saves and reloads it, round-trips a
+// batch of numbers and checks that a malformed key file is rejected.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "rsa.hpp"
+
+int main() {
+  const std::string pub_path = "rsa_example.pub";
+  const std::string priv_path = "rsa_example.priv";
+  const std::string bad_path = "rsa_example.bad";
+  int status = 0;
+
+  try {
+    rsa::RandomState random(2022);
+    rsa::KeyPair pair = rsa::KeyPair::generate(random, 256, 50, "example");
+    pair.pub.save(pub_path);
+    pair.priv.save(priv_path);
+
+    rsa::PublicKey pub = rsa::PublicKey::load(pub_path);
+    rsa::PrivateKey priv = rsa::PrivateKey::load(priv_path);
+    if (!pub.verify()) {
+      std::cerr << "signature does not verify\n";
+      status = 1;
+    }
+
+    std::vector<rsa::Integer> m, c, back;
+    for (unsigned long i = 0; i < 8; i++) {
+      m.emplace_back(1000 + i);
+      c.emplace_back();
+      back.emplace_back();
+    }
+    pub.encrypt_batch(m, c);
+    priv.decrypt_batch(c, back);
+    for (size_t i = 0; i < m.size(); i++) {
+      if (!(back[i] == m[i])) {
+        std::cerr << "block " << i << " does not round-trip\n";
+        status = 1;
+      }
+    }
+
+    FILE *bad = fopen(bad_path.c_str(), "w");
+    fputs("not a key\n", bad);
+    fclose(bad);
+    bool rejected = false;
+    try {
+      rsa::PrivateKey::load(bad_path);
+    } catch (const std::runtime_error &) {
+      rejected = true;
+    }
+    if (!rejected) {
+      std::cerr << "malformed key file was accepted\n";
+      status = 1;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    status = 1;
+  }
+
+  remove(pub_path.c_str());
+  remove(priv_path.c_str());
+  remove(bad_path.c_str());
+  if (status == 0) {
+    std::cout << "rsa.hpp example passed\n";
+  }
+  return status;
+}
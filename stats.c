@@ -0,0 +1,54 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "stats.h"
+
+static _Atomic uint64_t counters[RSA_STAT_COUNT];
+
+static const char *names[RSA_STAT_COUNT] = {
+    "mulmods",     "squarings",     "mr_rounds",   "prime_rejects",
+    "blocks",      "bytes_read",    "bytes_written", "key_load_ns",
+    "verify_ns",   "compute_ns",    "io_ns",
+};
+
+void rsa_stats_add(rsa_stat_t stat, uint64_t v) {
+  atomic_fetch_add_explicit(&counters[stat], v, memory_order_relaxed);
+}
+
+uint64_t rsa_stats_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void rsa_stats_get(rsa_stats_t *out) {
+  for (int i = 0; i < RSA_STAT_COUNT; i++) {
+    out->values[i] = atomic_load_explicit(&counters[i], memory_order_relaxed);
+  }
+}
+
+void rsa_stats_reset(void) {
+  for (int i = 0; i < RSA_STAT_COUNT; i++) {
+    atomic_store_explicit(&counters[i], 0, memory_order_relaxed);
+  }
+}
+
+const char *rsa_stats_name(rsa_stat_t stat) { return names[stat]; }
+
+void rsa_stats_print(FILE *f, bool json) {
+  rsa_stats_t s;
+  rsa_stats_get(&s);
+
+  if (json) {
+    fprintf(f, "{");
+    for (int i = 0; i < RSA_STAT_COUNT; i++) {
+      fprintf(f, "%s\"%s\":%" PRIu64, i ? "," : "", names[i], s.values[i]);
+    }
+    fprintf(f, "}\n");
+    return;
+  }
+  for (int i = 0; i < RSA_STAT_COUNT; i++) {
+    fprintf(f, "%s: %" PRIu64 "\n", names[i], s.values[i]);
+  }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Process-wide counters and phase timers for keygen, encrypt and decrypt.
+// Updates are atomic, so batch worker threads can share them; timers then
+// add up the time spent by every thread.
+// Building with -DRSA_NO_STATS (make STATS=0) compiles every update out and
+// leaves all counters at zero.
+//
+typedef enum {
+  RSA_STAT_MULMODS,        // pow_mod multiplications by the base
+  RSA_STAT_SQUARINGS,      // pow_mod squarings
+  RSA_STAT_MR_ROUNDS,      // Miller-Rabin rounds run by is_prime
+  RSA_STAT_PRIME_REJECTS,  // candidates make_prime threw away
+  RSA_STAT_BLOCKS,         // RSA blocks encrypted or decrypted
+  RSA_STAT_BYTES_READ,     // bytes read from the input file
+  RSA_STAT_BYTES_WRITTEN,  // bytes written to the output file
+  RSA_STAT_KEY_LOAD_NS,    // time reading key files
+  RSA_STAT_VERIFY_NS,      // time verifying key signatures
+  RSA_STAT_COMPUTE_NS,     // time in key generation and block arithmetic
+  RSA_STAT_IO_NS,          // time reading input and writing output
+  RSA_STAT_COUNT
+} rsa_stat_t;
+
+typedef struct {
+  uint64_t values[RSA_STAT_COUNT];
+} rsa_stats_t;
+
+//
+// Copies the current value of every counter.
+//
+// out: will store the counters, indexed by rsa_stat_t.
+//
+void rsa_stats_get(rsa_stats_t *out);
+
+//
+// Sets every counter back to zero.
+//
+void rsa_stats_reset(void);
+
+//
+// Returns the short snake_case name of a counter, as used in JSON output.
+//
+const char *rsa_stats_name(rsa_stat_t stat);
+
+//
+// Writes every counter to a file, one "name: value" line each, or as a
+// single JSON object.
+//
+// f: the file to write to.
+// json: true for JSON, false for plain text.
+//
+void rsa_stats_print(FILE *f, bool json);
+
+// adds v to a counter; use the STATS_* macros below rather than calling this
+void rsa_stats_add(rsa_stat_t stat, uint64_t v);
+
+// monotonic clock in nanoseconds
+uint64_t rsa_stats_now_ns(void);
+
+#ifndef RSA_NO_STATS
+#define STATS_ADD(stat, v) rsa_stats_add((stat), (v))
+#define STATS_TIMER(name) uint64_t name = rsa_stats_now_ns()
+#define STATS_LAP(stat, name)                                                  \
+  do {                                                                         \
+    uint64_t lap_ = rsa_stats_now_ns();                                        \
+    rsa_stats_add((stat), lap_ - (name));                                      \
+    (name) = lap_;                                                             \
+  } while (0)
+#else
+#define STATS_ADD(stat, v) ((void)(v))
+#define STATS_TIMER(name) ((void)0)
+#define STATS_LAP(stat, name) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif